@@ -0,0 +1,278 @@
+// \brief
+//		blue noise tile
+//
+
+#pragma once
+
+#include "pbrt.h"
+
+
+namespace pbrt
+{
+
+// 64 x 64 blue noise, ranks 0..4095 in row major order. thresholding the ranks at any level gives
+// evenly spread points without low frequencies, so (rank + 0.5) / 4096 is a blue noise value in [0, 1).
+// generated offline with void and cluster (Ulichney 1993), toroidal gaussian sigma 1.5.
+const int BLUE_NOISE_SIZE = 64;
+
+const uint16_t BlueNoiseRanks[BLUE_NOISE_SIZE * BLUE_NOISE_SIZE] =
+{
+	2781, 1244,  130, 3833, 1696, 2364,  398, 2644, 3897,  210, 3672,  653, 1715,  362, 2828, 1435,
+	3876, 1190, 2324, 3813,  429, 2519,  737, 2852, 3452,  164, 3033,  661, 2142, 1368,  600, 1670,
+	1025,  182, 2672, 2176,  107, 3905, 1692,  383, 4007,   48, 1042, 1990,  459,  905, 2064,  629,
+	1754, 3561, 1436,  348, 3381, 2800, 2217,  567, 2637, 1238, 3727, 3079, 2418, 3573, 3242,  768,
+	4025, 2283, 3387, 2870,  950, 3633, 1971,  625, 1476, 2134, 2579, 1243, 3457, 3204, 1043, 2363,
+	1930,   80, 2799,  707, 1779, 3373, 2112,  985, 1538, 2616, 3744, 1061, 2874,  307, 3979, 3357,
+	2422, 3017, 3704, 1576, 3165,  712, 2336,  946, 1536, 3271, 2375, 1380, 3552, 2945, 1463, 3294,
+	 139, 1123, 2577, 4036, 1664,   83, 3612, 1505, 3469,  131, 2102,  830,  417, 1494,   65, 1790,
+	1005, 1544,  571, 1889,  259, 3035, 1100, 3494, 3144,  938, 2885,  280, 2061, 1508, 3953,  584,
+	3537,  931, 3275, 2066, 1148, 4008,   27, 3671, 1877,  356, 1438, 2308, 3560, 1863, 2602,  810,
+	1409,  379, 1891, 1112, 2522, 3635, 1940, 3081, 2588,  551, 3713,  742, 2655,  251, 2258, 3938,
+	2721, 3158, 2100,  703, 2397,  956, 3059, 1953, 1038, 2947, 1602, 2548, 3917, 2862, 2195, 3638,
+	 238, 2689, 3790, 1362, 2550, 4080, 1616, 2332,   85, 3977, 1745, 3599,  749, 2715,  198, 2571,
+	3018, 1643, 3711, 2590,  346, 2779, 1329, 3056, 2477, 3327, 4026,  476,  880, 3094,   31, 2108,
+	3220, 3863,  680, 3525,  465, 1391,  218, 3782, 1179, 1900, 2978, 1606, 3879, 1882, 1220,  532,
+	 933, 1860,  428, 3695, 2894, 1385, 3784,  406, 2322, 4027,  548, 3319, 1856, 1167,  667, 3027,
+	3336, 1958,  802, 3212, 2149,  452,  778, 2766, 1939,  589, 1159, 3011, 2235, 3764, 1753, 1268,
+	2157,  289, 1348,  646, 3194, 1596, 2286,  505,  783, 1129, 2058, 2693, 1660, 1248, 3502, 1593,
+	2752,  972, 2317, 2867, 3331, 2153, 2727,  764, 3348,  368, 2220,  145, 1016, 3025, 3473, 2492,
+	3776, 1478, 3400, 1099, 1763,  241, 2581,  812, 3178, 1309, 2741,  981,  250, 3465, 2501, 1674,
+	1140, 2320, 3546,   25, 1178, 2958, 3422, 1328, 3751, 3272, 2498, 1448,  343,  966, 3147, 3480,
+	 725, 4095, 2386, 1849, 3793,  874, 3446, 3873, 1748, 2917,   98, 3192, 3799, 2435,  664, 4055,
+	 264, 1946, 1336,  110, 1743,  994, 4091, 1663, 2431, 1363, 3824, 3259, 2392,  608, 1623,  284,
+	2119, 2964,   26, 2242, 3231, 3935, 2082, 3429, 1803,   44, 2152, 3843, 2380, 1432, 3755,  361,
+	3946,  525, 2880, 1565, 3918, 1833, 2423,  244,  906, 2132,  432, 3928, 3379, 1915,   13, 2468,
+	1163, 2805, 3354,  226, 2681, 1980,  159, 1233, 2201, 3681, 1484,  735, 1894,  373, 2962, 1109,
+	2537, 3622, 3068, 3903, 2549,  582, 2984,   10, 3565, 2865,  792, 1986, 1322, 4045, 2641, 3298,
+	 728, 1236, 3621, 2738,  537, 1002, 1516,  474, 2854, 3688, 1586,  613, 3115, 1998,  841, 2948,
+	1349, 1793, 2578,  895, 2274,  601, 3651, 1522, 3090, 1785, 2859, 1049, 2306, 2782, 1499, 3826,
+	 475, 2008,  804, 1495, 1098, 3119, 2457, 2831,  322, 3248, 2540, 1072, 3425, 2215, 1469, 3370,
+	1756,  481,  766, 2101, 1212, 3699, 1486, 2302, 1037, 1822,  490, 2711, 3608,   77,  970, 1932,
+	3885, 2407, 1654,  836, 1969, 3043, 3544, 2516, 1173,  832, 3253, 2622, 1206,  113, 2677, 2184,
+	3579,  172, 3246, 3779,  278, 2997, 1051, 2609, 4035,   72, 3496, 1629,  509,  790, 3020, 2144,
+	3534, 1675, 2936, 3886, 3562,  673, 1618, 4052,  949, 1907,  519, 3975, 2855,  201, 3841,  865,
+	2381, 3235, 1585, 2847,  215, 3214, 1955, 3437,  320, 3957, 3181, 1113, 1712, 2211, 3140, 1510,
+	 431, 2871,  187, 4088, 2605, 1352,  122, 2218, 4011, 2011,  281, 3548, 1824, 3996, 3269,  618,
+	2992, 1012, 2077, 1276, 1704, 3513, 1925,  331, 2179,  821, 1334, 2561, 3846, 3431, 1291,  245,
+	 979, 3217,  397, 2304,   97, 2111, 3421,  488, 1452, 3549, 2160, 1298, 1716,  713, 2687, 1959,
+	  59, 3963, 1023, 3588, 2458,  898,  502, 2647, 1280, 2151, 2497,  256, 3427,  683, 2756, 3718,
+	1176, 3221, 2156, 1110, 3316,  445, 3801, 1730,  541, 3004, 1502, 2342,  517, 1040, 1488, 1917,
+	2402, 4051,  654, 2795, 2447,  704, 3267, 1230, 2709, 3659, 3216, 2071,  137, 1764, 2403, 4029,
+	2700, 1399, 2533, 1182, 1741, 2878, 1247, 2354, 3046, 2658,    3, 3138, 2488, 3689, 1175, 3062,
+	1427, 2746,  384, 2026, 1686, 3982, 1450, 3136, 3616,  602, 1475, 3800, 2923, 1306,  339, 2425,
+	 741, 1736, 3645,  652, 1587, 2365, 2824, 1014, 3415, 2592,  944, 3839, 2883, 2205, 3729,  353,
+	1305, 1665, 3305,   57, 3728, 1493, 2311, 3858,  561, 1821,  355, 1097, 2826, 3159,  927,  535,
+	1855, 3631,  719, 3986, 3280,  817, 3830,  194, 1842,  734, 3901, 1020,  446, 3291, 2175,  576,
+	3759, 2249, 1246, 3407,  676, 2930, 2340,  173,  955, 2812, 2013,  809, 2303, 1810, 4021, 2029,
+	3458, 2643,  268, 2912, 1950, 3682,  724, 1416, 1924,  191, 3215, 1308,    1, 3450,  798, 2761,
+	 228, 3557, 2198, 1181, 3070,  408,  957, 2900, 1579, 3022, 2370, 3972,  692, 1507, 3676, 2203,
+	3264,   45, 2128, 2731,  286, 1970, 2503, 3219, 1081, 3639, 1638, 2346, 1374, 1853,  136, 3497,
+	1676,  806, 3108, 2535,   94, 1177, 3791, 1909, 1620, 4012, 3247,   38, 3558, 1052, 3120,  112,
+	 958, 1411, 2264, 3961, 1260,   40, 3104, 3518, 2426, 3772,  666, 2088, 1591, 2580, 1815, 3193,
+	 983, 2524,  536, 1933, 2607, 4003, 2133,   92, 3508,  871, 1317, 3375, 1864, 2525,  188, 2803,
+	1164, 1668, 3092, 1443, 1004, 3459,  606, 1470, 2154, 2774,  267, 3463, 2973, 4081,  894, 2424,
+	2884,  262, 4013, 1783, 3623, 2190,  786, 3087, 2570,  441, 1143, 1680, 2544,  590, 2717, 1625,
+	3817, 3082,  461, 3337,  853, 2538, 2081,  329, 1120, 1652, 2783, 4060, 3093, 1121,  485, 3934,
+	1556, 3040, 3840,  885, 1647, 3423, 1149, 1867, 2434, 3811,  207, 2182,  482, 3769, 1358, 3492,
+	 822, 3940,  565, 2335, 3774, 1717, 2834, 4034,  451, 3332,  917, 2025,  611, 2678, 1468, 3250,
+	1103, 2091, 1361,  555, 2754, 1549, 3447,  255, 1313, 3490, 2113, 2988, 3909, 1395, 3444,  413,
+	2216, 1830, 1146, 2739, 1718, 3809, 1471, 2845, 3660,  460, 2337,  887,  350, 3630, 2377, 2055,
+	3454,  152, 1354, 2849,  294,  650, 3143, 2780,  456, 1487, 2623, 3072,  943, 2906, 2042,  340,
+	2621, 1834, 3377,  318, 3002, 1171,  143, 2282, 1267, 1749, 2572, 3814, 1224,  283, 1943, 3803,
+	 645, 3551, 2373, 3182, 1009,  371, 2901, 2045, 3760,  635, 2414,  828,  199, 1982, 2382,  846,
+	2860, 3617,  695, 2181,  232, 3386,  569,  926, 3197, 1999, 1271, 3420, 1895, 1426, 2919,  663,
+	2707, 1957, 2294, 3276, 3775, 2486, 1337, 3637,  818, 3224, 1837, 1174, 4077, 1699,  717, 3190,
+	2173, 1229, 2777,  902, 2031, 2532, 3489,  855, 3703, 3023,   67, 1545, 3131, 2314, 2820,  378,
+	1770, 2617,   23, 3732, 1887, 3947, 2452, 1046, 1791, 2790, 1439, 3179, 3615, 1108, 3064, 3984,
+	1310,  334, 3226, 4065, 1300, 2969, 2372, 1781, 2594, 3958,  224, 3009, 2666,   76, 3882, 1073,
+	 422, 4092,  716, 1128, 1804, 2115,  222, 1673, 2275, 3889,  610, 3413,   21, 2399, 3636, 1482,
+	3862,  213, 3601, 1473, 3969,  660, 3196, 1911, 2449,  591, 2165, 3504,  770, 3951, 1071, 3412,
+	3029, 1211, 1589,  767, 2251, 1425,  690, 3290,   90, 4075,  394, 1726, 2576,  559, 1581,   49,
+	2591, 2053, 1534, 2462,  889, 1947, 3864,   74, 1405,  696, 3563, 1609,  851, 2213, 3289, 1762,
+	3586, 1539, 2786,   86, 3536,  948, 4022, 2911, 1105,  166, 2832, 2155, 1344, 2742,  372, 1032,
+	2543,  672, 2369, 3163,   29, 1698, 1221,  296, 1497, 3997, 1027, 2753, 1820,  204, 1603, 2130,
+	 870, 4049, 2720, 3408, 3058,  202, 3640, 2986, 1263, 2276, 3351,  936, 3892, 2138, 3464, 1843,
+	3304, 1017, 2796,  135, 3522,  511, 1152, 3471, 2951, 2243, 1116, 2491, 3730,  554, 1307, 2536,
+	 939, 2383, 3232, 1384, 3030, 2606,  679, 3279, 1984, 2512, 1521, 3734,  840, 3152, 2005, 3477,
+	2985, 1794, 1136, 1978, 2694, 3796, 2918, 3595, 2618, 3145, 1356,  478, 3285, 2595, 3643,  570,
+	2438,  168, 2001,  480, 1111, 2565, 1580, 2015, 2630,  597, 1904, 2940,  323, 1240, 2806,  801,
+	3715,  580, 3874, 1728, 3028, 2297, 2734, 1621,  416, 3318, 1850,  306, 3154, 1975, 2897,  227,
+	2120,  501, 3925, 2022,  336, 2256, 1458,  440, 3680,  765, 3363,  415, 1760, 3960,  631, 1568,
+	 147, 4014, 3333,  449,  925, 2285,  529, 2104,  839,  212, 2054, 3733, 2277, 1191, 2950, 1430,
+	3771, 3109, 1369, 3594, 1828, 3981,  867,  365, 3807, 1091, 3576, 1489, 2326, 3742,  181, 2443,
+	1414, 2261, 3191,  401, 1375, 3783,  726, 1993, 3912,  922, 2810, 4044, 1503, 1030, 3844, 3448,
+	2762, 1702, 1165,  771, 3609, 1766, 3870, 2703, 1225, 1835, 2991, 1115, 2640, 2331, 1262, 2772,
+	2114,  785, 1400, 2837, 3550, 1567, 1144, 3281, 1799, 3860, 2848, 1595,  869,   41, 1922, 3340,
+	 359,  984, 2360, 2914,  647, 2231, 2814, 3426, 1713, 3122,    9, 2664,  854, 3262, 1747, 3101,
+	 410, 1912, 1186, 2646, 2092, 1001, 3200,  180, 2513, 1338,  585, 2174,  119, 2417,  658, 1350,
+	  15, 3785, 2961, 2430, 3293, 1068,   61, 3189, 2378,  249, 3822, 2089,   87, 3296,  337, 3827,
+	3209, 2437, 3708, 2087,  335, 2528, 4084,   81, 2427, 1228,  418, 3493, 2545, 4024,  643, 2679,
+	2183, 1765, 3894,  216, 1242, 3288,  115, 1382, 2412,  700, 2146, 3916,  470, 2038, 1024, 4057,
+	2712, 3568,  852, 3943,   22, 3545, 1559, 2204, 2909, 3690, 1751, 3478, 2671, 3315, 1807, 3110,
+	1041, 1979,  311, 1526,  572, 2823, 2161,  793, 1533, 3481,  636, 2763, 1622, 3593,  975, 1858,
+	 493, 1169,  104, 1689, 3123,  769, 2956, 1645, 3585, 3106,  743, 2000, 1410, 3060, 1133, 3709,
+	1524,  733, 3244, 2589, 1630, 3812, 2076,  969, 4037, 2929, 1296, 1693, 3442, 2891, 1335,  670,
+	1627,  237, 3286, 2345, 1740, 2745,  550, 3436, 1126,  315, 3080,  773, 1234,  420, 3970, 2267,
+	3564, 2597, 3207, 3700, 1919, 4039, 1270, 3378, 2857, 2020, 1180, 4067,  823, 2194, 3041, 2493,
+	1592, 2896, 3356,  951, 3823, 1339, 2062,  542,  976, 2189, 2632, 3306,  258, 1792, 2343,  127,
+	3507, 2873,  472, 1974,  791, 2981,  424, 2730, 1886,  246, 3675,  978, 2293,  148, 3632, 2479,
+	2143, 2905, 1421,  687, 3107, 1245, 4062,  876, 1884, 2394, 1462, 3899, 2048, 2844, 1540,  750,
+	1655,  499, 1325,  968,  134, 2475, 1707,  285, 3798,  473, 2521, 1466, 2915,  426, 1366, 3736,
+	 746, 4032, 1901, 2240, 2657,  288, 3390, 2760, 3914, 1483,  390, 3620, 1006, 3802, 2759,  862,
+	1331, 2295, 4089, 1160, 3658, 2333, 1445, 3607,  637, 2472, 3049,  531, 2750, 1460, 3233,  447,
+	3898,  974, 1976, 3795,  292, 2141, 2552,  396, 2999, 3781,   46, 2586,  945, 3606,  156, 2953,
+	2419, 3955, 2107, 2696, 3053, 3451,  678, 2266, 1022, 1778, 3237,  158, 3693, 1873, 3311,    8,
+	2692, 1274,  257,  634, 3553, 1813, 1082, 2355,  171, 1892, 2877, 1340, 2159,  604, 3161, 1938,
+	3396,  304, 1608, 2755,   32, 3401, 1026, 3153, 1672, 1101, 3406, 2017, 4005,  833, 1880, 1151,
+	3037,   82, 3467, 2518, 1070, 3673, 1577, 3317, 1299, 2098, 3405,  573, 1789, 2307, 1214, 3455,
+	 921,  193, 3361,  593, 1578, 1117, 3926, 2662, 3039, 3556,  745, 2236, 2613,  651, 1132, 2339,
+	2039, 3488, 3172, 2416, 1479, 3995, 3038,  702, 3644, 3176,  775, 4053, 2566, 1683,  214, 3939,
+	2547,  963, 2117, 3257,  649, 1742, 2164,  223, 3908, 2253, 1370,   99, 1640, 2575, 3746, 2368,
+	1552, 2695, 1710,  524, 3052, 1913,  120, 2818,  641,  988, 1659, 2903, 3255, 4074,  386, 1988,
+	1447, 3003, 1814, 3761, 2338,  392, 1962, 1444,   37, 2124, 1223, 3987, 1537, 3519, 2954, 3904,
+	 479, 1612, 1063, 2902,  882,   60, 2185, 1324, 1685, 2495, 1141,   14, 3084, 3542, 1170, 1551,
+	 560, 2949, 3737, 1360, 2587, 3974, 2889,  820, 2627,  486, 3762, 2797,  723, 3091,  254,  592,
+	3382,  805, 4016, 2208, 1390,  868, 3456, 2289, 3999, 2665, 3717,  197, 1357,  722, 2705, 3180,
+	 538, 2546, 1210,  811, 2861, 3530, 3228,  857, 3836, 1611, 2927,  297,  903, 2016,  240, 1755,
+	 800, 2757, 3945,  366, 3313, 1735, 2827, 3849,  301, 3505, 2224, 1504, 1961,  751, 2879, 2247,
+	3308, 1811,  160,  849, 2012,  442, 1231, 3535, 1846, 3078,  967, 2122, 3368, 1265, 2212, 3602,
+	1968, 1315,  200, 3323, 2765, 3878,  543, 1759, 1408,  327, 2232, 1047, 2510, 2059, 1604, 3739,
+	3433, 2085, 4031,  108, 2136, 1330,  271, 2811, 2400,  520, 3438, 2668, 3282, 2429, 1297, 3254,
+	3668, 2466, 1393, 1944, 2305, 3574,  533, 1062, 3278,  619, 2787, 3861,  409, 2436, 3724,  314,
+	1021, 3868, 2315, 3088, 3653, 1548, 3284, 2395,   69, 1480, 3578, 1758,  369, 3985, 1701,  996,
+	2747, 3162, 2481, 1077,  333, 2035, 2542, 3151,  888, 3297, 1888, 3511, 3026, 3851,   68, 1090,
+	1691,  338, 2966, 1594, 3663, 2554, 1871, 1185, 3569, 2040,  992, 1827,  612, 3780, 2850, 1039,
+	1902,  179,  686, 3788, 1172, 2670, 1527, 2467, 1798, 2069,  920, 3149, 1114, 3417, 1381, 2046,
+	2768, 1515,  586, 1145, 2729,  253, 2095, 1048, 4070,  628, 2931, 2470,  883, 2634, 3007,   30,
+	3842,  500, 1787, 3712, 1530, 3538, 1203,    7, 3805, 2846,  627, 1513,  405,  877, 2829, 2401,
+	 729, 2635,  989, 3347,  498,  911, 4001,  648, 2977,  146, 3952, 1412, 2228,   50, 1667,  468,
+	3105, 3520, 2158, 2994,  106,  813, 4066,  247, 2967, 3710,  126, 1631, 2610, 1844,  616, 3950,
+	 109, 3495, 2476, 3346, 1805, 3884,  715, 3166, 2585, 2006, 1254,  150, 3789, 1383,  624, 2387,
+	1481, 2135,  842, 2922, 2408,  614, 2996, 1985, 1615, 2379, 1227, 3941, 2316, 3366, 1910, 3626,
+	3205, 3848, 1283, 2287, 1733, 2704, 3265, 2206, 1695, 1264, 2485, 3015, 3482,  940, 4079, 2260,
+	2629, 1520,  999, 3335, 1700, 2842, 2170, 3236, 1124, 1386, 2323, 4020,  360, 3245,  959, 2350,
+	3061, 1875, 1303,  367,  947, 2271, 2898, 1639,  310, 3268, 3686, 2244, 3086, 2014, 3355, 3591,
+	1085, 3213, 4085,  105, 1897, 1008, 3980, 2656,  515, 3657,  163, 2722, 1738, 1161,  219, 1379,
+	 527, 1935,   16, 3698, 3085,  183, 1491,  404, 3684, 3343,  727,  341, 1795, 2725, 3349, 1279,
+	 738, 3906,  317, 2461, 1258, 3499,  471, 1898,  689, 3353, 2716,  844, 2099, 2882, 3572, 1605,
+	 448,  827, 4043, 2659, 3570,  167, 1321, 3506, 1089, 1812,  819,  491, 1610,  971,  234, 1774,
+	2764,  354, 2499, 1294, 3485, 3188,  220, 1394, 3388, 1045, 2093, 3263,  557, 2934, 3990, 2278,
+	1582, 3000, 2531,  761, 2057, 1137, 3895, 2409,  941, 2769, 2067, 3845, 1192,  568, 2023,  165,
+	2925, 1782, 3646,  621, 1960, 3865, 1015, 2551, 3930, 1681,  412, 3613, 1511,   84, 1251, 2642,
+	3749, 2168, 2928, 1528, 1996, 3125, 2598,  607, 3948, 2463, 2835, 3321, 4030, 2674, 2328, 3896,
+	 668, 1555, 3641,  779, 2097, 1543, 2233,  763, 2451, 2983, 1566,  837, 3702, 2021,  910, 2675,
+	3399, 1087, 4093, 1406, 3532, 2840,  595, 3124, 1881,   71, 1453, 3155, 2583, 3597, 1573, 3199,
+	2507, 1094, 2191, 3148, 2737,  272, 1500, 2933,   28, 2180, 3069, 1069, 2487, 3919,  609, 2010,
+	1035, 3266,   66,  675, 1104, 3900, 1694, 2193,    6, 1424, 1994,  270, 1333,  564, 3063, 1250,
+	2148, 2907, 1829, 3095,  462, 2809, 3825, 3533, 1831,  265, 4063, 2599,   64, 1628, 3157,  279,
+	 721, 2234,  453, 1865,  239, 2254, 1583, 3598, 1239, 4050, 2344,  866,  195, 2167,  961, 3923,
+	 544, 3397,   54, 1355,  864, 3287, 2273, 3460, 1241, 3679,  596, 1954, 3338, 1752, 2971, 3430,
+	 287, 1727, 2471, 3667, 2301,  400,  879, 3648, 2932, 3414, 1011, 3731, 2269, 1708, 3619,   58,
+	3299,  952,  184, 3933, 2428,  987,  345, 1196, 3076,  630, 2200, 1351, 3529, 2384, 1197, 3880,
+	1771, 3650, 2582, 2944, 3376,  795, 2651,  351, 2960,  693, 3398, 1598, 3808, 3067,  403, 2352,
+	1442, 1878, 4041, 2601, 1634, 3818,  640, 1852,  884, 2460, 1455, 2758,  221,  900, 2290, 1404,
+	2726, 3949, 1277, 3047, 1601, 3384, 2714, 1249, 1869,  623, 2496, 3098,  780, 2775, 1079, 1916,
+	2530, 3773, 2255, 1204, 1666, 3314, 1992, 2567, 1501, 3692, 2791, 1058, 3252,  414, 2838, 2084,
+	  89, 3111,  919, 1253, 1690, 3697, 1102, 2131, 1719, 2505,  299, 1966, 2785, 1218, 1802, 3674,
+	2856,  777, 2230,  377, 2908, 2043,  142, 2680, 3856,  309, 3201, 4083, 1266, 3528,  430, 3721,
+	 732, 2118,  454,  847, 2564,  117, 2041, 3218,  305, 3989, 1619,  129, 2073, 3915,  357, 3440,
+	 755, 1457,  507, 3517, 2987,  710, 3998,   33, 3403,  928,  380, 2030, 1746,  674, 3714, 1364,
+	3441, 1574,  308, 3831, 2413,   47, 3083, 3883,  886, 3206, 3720, 1033,  522, 2446, 3449,  102,
+	1127, 3186, 3735, 1208, 3432,  964, 3175, 1302, 3005, 1767, 2223,  739, 2086, 3075, 1561, 2500,
+	1156, 3225, 3587, 1972, 4069, 1428, 3757,  787, 2321, 1166, 2816, 3498, 1419, 3169, 2312, 1607,
+	2713, 3114, 1883, 2612,  243, 1446, 2743, 2188, 1729, 2415, 3954, 2937, 3575, 2514,  990, 2281,
+	 553, 2654, 2199, 3238,  574, 2024, 1437, 2735,  178, 1365, 2221, 2913, 4006, 1525,  814, 2096,
+	2574,  298, 1705,  577, 2473, 1572, 3618, 2389,  506, 1054, 3634,  151, 2697, 1841, 3936,   19,
+	2904, 1637,  211, 2821, 1135,  563, 2920, 1722, 2639, 3666,  829, 1896,  496, 1130,  688, 3820,
+	 114, 1162, 4040,  915, 2145, 3766, 1138,  457, 3146, 1289,  225,  797, 1464,  140, 4042, 2965,
+	 859, 3920, 1826,  982, 2825, 4023,  760, 3367, 1927, 3567,  615, 1697,  141, 3261, 2719, 3794,
+	1343, 3531, 3042, 1989, 3991,  233,  754, 1879, 3962, 1490, 2517, 3283, 1193,  549,  942, 2250,
+	3402,  659, 2464, 1784, 3185, 2292, 3404,  157, 1396,  436, 3251, 2404, 4076, 2624, 2989, 1967,
+	3527, 2225,  376, 3300, 1679, 2926, 3475,  860, 3707, 2701, 1890, 3360, 2196, 3208, 1226, 1906,
+	3501, 1378,  407, 3584, 1292, 1768, 2555,  437, 2347, 1134, 2645, 3128, 2063, 1157,  425, 1845,
+	 633, 2327,  929, 2699, 1284, 2876, 2245, 3334,   55, 2968,  826, 1706, 3852, 2833, 3514, 1903,
+	1332, 3871, 1003, 3740,  302,  901, 2002, 3966, 2851, 2126, 1584,   39, 3371, 1650,  261, 1314,
+	 744, 2881, 1434, 2454,  642,  190, 1921, 2439, 1575,  620, 3854, 1028, 2593, 1714,  450, 2789,
+	  18, 2147, 3034, 2474,  276, 3177, 1074, 3748, 1563, 3942,  319,  908, 3828, 2374, 3395, 2864,
+	4094, 1541,    5, 3372,  395, 3821, 1649, 1122, 2667, 2034, 3476,  385, 2137, 1519,  252, 2619,
+	 463, 3074, 2036, 1485, 2718, 3566, 1319,  516,  965, 3743, 3054, 1255,  897, 2150, 3716, 2391,
+	3359, 1800, 3683, 1078, 3937, 2636, 1353, 3292,  111, 2288, 2863,  342, 3600,  709, 3741, 2357,
+	1118, 3374, 1632,  816, 3723, 2219,  116, 2686,  638, 3013, 1876, 3462, 1417,  697, 1635,  192,
+	1055, 2615, 3691, 1725, 2123,  796, 3036,  443, 3747,  662, 1301, 2469, 3168, 1057, 2993, 4054,
+	 890, 2358,  125, 3310,  685, 1669, 2608, 3202, 2318, 1819,  656, 2733, 3869,  411, 3127, 1050,
+	 497, 2698,    2, 3050, 2075, 3510,  762, 2974, 4087, 1201, 1684, 3156, 1387, 2072, 3048, 1531,
+	2736, 3867,  477, 2910, 1859, 1347, 3500, 2028, 3345, 1275, 2263,   36, 2553, 2990, 3649, 2207,
+	3256, 1928,  484, 3097, 1083, 2539, 3491, 1413, 2351, 1775, 4000,  103, 3605,  694, 2300, 1809,
+	1467, 3629, 2890, 1202, 3988, 2227,   62, 3859, 1209,  326, 3577, 2359, 1908, 1407, 2584, 1671,
+	4019, 2121,  899, 1633,  389, 1213, 1808,  421, 2003,  845, 3765, 2169,  153,  953, 4017,  321,
+	 740, 2019, 1060, 2410, 4078,  665, 2817, 1677,  937,  455, 2843, 4002, 1066, 1905,  374, 1285,
+	 671, 3924, 1402, 2284, 3624,  534, 1963,  189, 3380, 2979,  924, 2724, 1945, 1371, 3758,  162,
+	3352,  539, 1847, 2482,  433, 3141, 1874,  757, 2872, 3365, 1558,  118, 2980,  720, 3628,  206,
+	3012, 1367, 3394, 3819, 2259, 2819, 3687, 2388, 3342, 2776,  467, 2556, 3461, 2836, 1840, 2484,
+	3669, 3112, 1553,   79, 3295, 1158,  364, 3902, 2453, 3661, 1818, 1509,  547, 3229, 3806, 2770,
+	2356, 2957,  916,  170, 2702, 1599, 4046, 2798, 1096,  489, 2187, 1590, 3312,  391, 2660, 3121,
+	1187, 2186,  934, 3787, 1532, 1053, 3526, 1398, 2448, 2004,  918, 4033, 1188, 3322, 2060,  960,
+	2348,  639, 2541,  235, 3139,  581, 1007, 1403,   70, 1588, 3554, 1131, 1517,  587, 3249, 1216,
+	2229,  358, 3503, 2611, 1731, 2237, 3142, 1465,  101, 3071,  776, 3411, 2604, 2127,  893, 1624,
+	  73, 3524, 1761, 3838, 3211, 1252,  835, 2268, 1721, 3834, 3134,  731, 3944, 1018, 2044,  632,
+	2526, 3678, 2792,  100, 2976, 2070, 2648,  208, 3797,  546, 3173, 2633, 1739,  494, 2822, 3907,
+	1788, 3590, 1153, 1926, 1498, 3887, 2563, 3055, 3983, 2192,  714, 1965, 3932, 2329,   88, 1644,
+	 684, 2887, 1290,  599, 3694,  863, 2661, 3559, 2129, 1235, 2366,  177, 3875, 1372,  295, 3171,
+	1995, 1168, 2562,  691, 2051,  290, 3582, 3077,   52, 2559, 1259,  248, 2390, 2895, 1687, 3888,
+	1496,  347, 1734, 3470,  781, 4058,  503, 3051, 1724, 1088, 2177,  269, 3592, 2411, 1422,   63,
+	3089,  466, 2691, 3320,  848, 2109,  291, 1862,  904, 2650, 3230,  196, 2972,  892, 3424, 3857,
+	1107, 2489, 3976, 2079, 2921,  277, 1868,  552,  954, 4048, 2893, 1866, 1092, 2982, 3580, 2441,
+	4056,  458, 3391, 1449, 2938, 2444, 1857,  626, 1474, 3662, 2065, 3409, 1418, 3581,    4, 3065,
+	 875, 3260, 2125, 1288, 2406, 1658, 1013, 2241, 3547, 2723, 3890, 1318,  753, 1951, 3393, 1106,
+	2209, 1614, 3931,  144, 2868, 3474, 1282, 3664,  504, 1346, 3816, 2445, 1797, 1359, 2631, 1981,
+	3307, 1832,  154, 1571,  993, 3891, 1415, 3428, 2751, 1653,  438, 3329,  711, 2272, 1557,  617,
+	 977, 2869, 2246,  349, 3479, 1064, 3956, 2653, 3241,  881,  464, 2706, 1854,  803, 2214, 1278,
+	2385, 3754,  558, 2740,  186, 3344, 3738, 1440,  774,   17, 1613, 3021, 2523, 3829,  381, 2732,
+	3654,  655, 1342, 2341, 1709,  682, 2279, 2784, 3167, 1720,  363, 1086, 3541,  513, 3100,  324,
+	3804,  858, 3001, 3453, 2197, 3203, 2515, 2032,  203, 3655, 1392, 2080, 3756,  352, 2815, 1885,
+	3274, 1272, 1825, 3866,  807, 1688,  138, 1215, 1987, 2353, 4061, 1119, 3117,  528, 3965, 2804,
+	 273, 1786, 1076, 3921, 3008, 1949,  325, 2433, 3277, 1991, 3418,  523, 1031, 1662, 3240,  843,
+	1848, 2494, 3484,  986, 3045, 4064,   35, 1075, 2050, 3571, 2262, 2858,  752, 4071, 2202, 1518,
+	2728,  521, 2367, 1237,  657,   53, 1184,  747, 3073, 2296,  834, 2676, 3130, 1293, 3929,  242,
+	3642, 2626,  155, 3044, 2074, 2767, 3309, 3726,  332, 2970, 1682,  121, 3614, 2455, 1034, 1941,
+	3523, 3150, 2534, 1569,  706, 1205, 2663,  594, 2899, 1222, 2310, 4086, 2794,  123, 2270, 1376,
+	4010,  217, 3187,  483, 2009, 1420, 2483, 3767,  788,  229, 1477, 3341, 1956, 2558,   12, 1036,
+	1937, 3652, 1626, 4018, 2628, 3516, 2853, 1750, 3973, 1217, 3416,   11, 1773,  997, 2504, 2052,
+	 861, 1642,  669, 3555, 1377,  487, 2239, 1547,  748, 3487, 1295, 2778, 2037, 1506, 3383,  444,
+	1433,  815,   78, 3627, 2178, 3195, 3971, 1836, 3777,  872,  274, 1456, 2047, 3113, 3604,  545,
+	2942, 2106, 1232, 2603, 3656,  393, 3270, 1656, 3024, 2652, 3927,  419, 1198, 1600, 3057, 3512,
+	1341,  169, 3184,  402, 1914, 1454, 3752,  303, 2459,  562, 1973, 3910, 2349,  578, 3445, 1441,
+	3118, 3964, 2313, 1125, 2508, 4015,  962, 3116, 2620, 1934,  510, 3768,  824,  236, 2955, 2600,
+	3792, 2299, 1851, 2801,  427, 1472,  991,   96, 1546, 3472, 2688, 3701,  730, 1183, 1711, 2614,
+	 998, 1617, 3855,  756, 1777, 2875, 1147,  566, 1918, 1273, 2371,  891, 3234, 3763,  677, 2291,
+	 912, 2569, 2110, 1093, 3019,  789, 2226, 1019, 3223, 1523, 2916,  399, 1388, 3665, 2963,   95,
+	2684,  469, 1870, 3389,   24, 2839, 1823,  231, 3872, 1044, 2511, 3183, 2309, 4004, 1780,  699,
+	1194, 3010, 4073,  913, 3385, 2506, 3596, 2222, 3126, 2442,  508, 1816, 3303, 2478,  330, 3745,
+	3227,  133, 2841, 2252, 3325,  174, 2398, 3992, 3369,  128, 3603, 2090, 2771,  205, 1769, 2939,
+	3364, 3853,  579, 3722, 2480,  149, 3324, 1872, 2683, 3835,  896, 3339, 2708, 1838,  794, 2139,
+	1199, 3725,  935, 2975, 1535,  705, 3589, 2140, 1397, 3301,   51, 1744, 1373, 1056, 3326, 2103,
+	 161, 1646,  530, 1327, 2027,  316, 2888,  698, 1936, 1281,  973, 2946,   43, 3994, 2166,  799,
+	1899, 3515,  518, 1461, 1010, 3706, 1529, 2116,  909, 2808, 1703,  556, 1401, 2432, 4009,  387,
+	1514, 2793, 1817, 1316, 3435, 1651, 4068,  526, 1269,  124, 2083, 2450, 1155,  293, 3993, 1550,
+	3350, 2456,  275, 2163, 3850, 2440, 1139, 3006,  622, 2248, 3610,  718, 3014,  300, 2749, 3685,
+	2527, 3543, 3133, 2710, 3753, 1737, 1200, 4028,  175, 3392, 3877, 2033, 1564, 1095, 3099, 1451,
+	2396, 1189, 2568, 4047, 1977,  708, 2685, 3132,  439, 1195, 3893, 3016, 3486,  784, 2018, 1150,
+	2405,   75,  838, 2319,  344, 2813,  873, 3066, 2280, 3539, 1648,  605, 3778, 3103, 2298, 2866,
+	 598, 1732, 3129, 1345,  495, 3258, 1723,  312, 4082, 1554, 2830, 2007, 3837, 2393,  583, 1429,
+	 850, 1997, 1084,   20, 2238,  808, 3032, 2362, 1657, 2557,  423, 2788, 3647,  603, 2649,  370,
+	3911,  701, 3170,    0, 2892, 3509,  328, 1311, 3750, 2529, 1983,   42, 1080, 2669, 3625, 3102,
+	1942, 3968, 2935, 3611, 1931, 1142, 2520, 1562, 3786,  382, 2748, 3419, 1948,  923, 1320,  185,
+	3583, 1065, 4038, 2690, 1929,  914, 3540, 2773, 2465,  878,  375, 1154, 3358, 1570, 1920, 3959,
+	3210,  434, 2421, 3978, 1512, 3302,  263, 3705,  930, 3174, 1459,  831, 2325, 3328, 1952, 3466,
+	2807, 1801, 2171, 1542, 1067, 2420, 1641, 2056, 3434,  644, 1492, 3330, 2257, 1678,  230,  681,
+	3468, 1029, 1560,  492, 3135, 3922,   34, 2068,  736, 3243,  995, 1423,   56, 2638, 3696, 1806,
+	2560, 2105,  782,  132, 3670, 2265,  209, 1219, 1893, 3239, 3677, 2573,   91,  907, 2802,  260,
+	1257, 2886, 1776, 3439,  540, 2490, 1964, 1304,  588, 2162, 3815,  266, 1256, 1661,   93, 1000,
+	1323,  282, 3832, 3273,  512, 3770, 3031,  176, 2376,  980, 2744, 4090,  514, 2943, 3847, 1431,
+	 388, 3198, 2094, 2596,  758, 1389, 3410, 2959, 1207, 1839, 2361, 2995, 4059, 2172,  772, 3137,
+	 435, 3362, 1597, 2952, 1286, 3160, 1636, 3913,  575, 2210, 1312, 1796, 3881, 3164, 2334, 3521,
+	2078, 3810,  759, 1326, 2941, 1059, 3483, 2682, 2924, 1757, 3443, 2625, 3096, 4072, 2502, 3719,
+	2998, 2330,  825, 2673, 1923, 1261,  856, 3967, 1772, 3222,  313, 1861, 1287,  932, 2049, 2509,
+};
+
+} // namespace pbrt
@@ -26,12 +26,6 @@ FColor FresnelDielectric::Evaluate(Float cosThetaI) const
 //////////////////////////////////////////////////////////////////////////
 // Micro facet model
 
-FMicrofacetReflection::~FMicrofacetReflection()
-{
-	delete distribution;
-	delete fresnel;
-}
-
 FColor FMicrofacetReflection::Evalf_Local(const FVector3& wo, const FVector3& wi) const
 {
 	Float cosThetaO = abs_cos_theta(wo), cosThetaI = abs_cos_theta(wi);
@@ -77,11 +71,6 @@ FBSDFSample FMicrofacetReflection::Sample_Local(const FVector3& wo, const FFloat
 	return sample;
 }
 
-FMicrofacetTransmission::~FMicrofacetTransmission()
-{
-	delete distribution;
-}
-
 FColor FMicrofacetTransmission::Evalf_Local(const FVector3& wo, const FVector3& wi) const
 {
 	if (same_hemisphere(wo, wi)) return 0;  // transmission only
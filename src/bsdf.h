@@ -685,8 +685,6 @@ public:
 
 	}
 
-	~FMicrofacetReflection();
-
 	bool IsDelta() const override { return false; }
 
 	FColor Evalf_Local(const FVector3& wo, const FVector3& wi) const override;
@@ -696,6 +694,7 @@ public:
 
 protected:
 	const FColor R;
+	// not owned, they live in the same memory arena as the bsdf
 	const MicrofacetDistribution* distribution;
 	const Fresnel* fresnel;
 };
@@ -713,8 +712,6 @@ public:
 		, fresnel(etaA, etaB)
 	{}
 
-	~FMicrofacetTransmission();
-
 	bool IsDelta() const override { return false; }
 
 	FColor Evalf_Local(const FVector3& wo, const FVector3& wi) const override;
@@ -725,6 +722,7 @@ public:
 private:
 	// MicrofacetTransmission Private Data
 	const FColor T;
+	// not owned, see FMicrofacetReflection
 	const MicrofacetDistribution* distribution;
 	const Float etaA, etaB;
 	const FresnelDielectric fresnel;
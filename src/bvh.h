@@ -6,6 +6,10 @@
 
 #include "pbrt.h"
 #include "geometry.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <mutex>
 
 namespace pbrt
 {
@@ -13,6 +17,8 @@ namespace pbrt
 	class FIntersection;
 
 #define MAX_HITTABLES_IN_LEAF	5
+// subtrees with at least this many objects are built as tasks on the global parallel system
+#define MIN_PARALLEL_BUILD_SPAN	4096
 
 	inline bool box_compare(const FBounds3& a, const FBounds3& b, eAxis axis)
 	{
@@ -34,6 +40,12 @@ namespace pbrt
 		return box_compare(a->WorldBounds(), b->WorldBounds(), eAxis::AXIS_Z);
 	}
 
+	template<typename T> class FBVH_NodeLeaf;
+	template<typename T> class FBVH_NodeLazy;
+
+	class FBVH_NodeBase;
+	typedef std::vector<const FBVH_NodeBase*> FBVHStack;
+
 	// bvh node
 	class FBVH_NodeBase
 	{
@@ -42,6 +54,33 @@ namespace pbrt
 		virtual ~FBVH_NodeBase() {}
 
 		virtual bool Intersect(const FRay& ray, FIntersection& oisect) const = 0;
+		// deep copy of the nodes, allocated by the calling thread. the objects are shared
+		virtual std::shared_ptr<FBVH_NodeBase> Clone() const = 0;
+
+		// same as Intersect without recursion, the nodes to visit are kept on the caller's stack.
+		// nested traversals may share the stack, each only pops what it pushed
+		bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+		{
+			const size_t base = stack.size();
+			bool bHit = false;
+
+			stack.push_back(this);
+			while (stack.size() > base)
+			{
+				const FBVH_NodeBase* node = stack.back();
+				stack.pop_back();
+
+				++visited;
+				bHit |= node->Visit(ray, oisect, stack, visited);
+			}
+
+			return bHit;
+		}
+
+		// one step of Traverse: intersect the objects of a leaf or push the children to visit.
+		// objects with a bvh of their own continue the traversal on stack, see FShape::Traverse
+		virtual bool Visit(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const = 0;
+
 		const FBounds3& bounding_box() const
 		{
 			return bbox;
@@ -56,7 +95,10 @@ namespace pbrt
 	{
 	public:
 		// [start, end)
-		FBVH_Node(std::vector<T>& objects, size_t start, size_t end)
+		// lazyDepth < 0 builds the whole tree, otherwise only lazyDepth levels are built here
+		// and the subtrees below them are built on first traversal, see FBVH_NodeLazy.
+		// bParallel false builds on the calling thread only, for builds started by a traversal
+		FBVH_Node(std::vector<T>& objects, size_t start, size_t end, int lazyDepth = -1, int depth = 0, bool bParallel = true)
 		{
 			int axis = random_int(0, 2);
 			auto comparator = (axis == eAxis::AXIS_X) ? box_x_compare<T>
@@ -76,8 +118,22 @@ namespace pbrt
 				std::sort(objects.begin() + start, objects.begin() + end, comparator);
 
 				auto mid = start + object_span / 2;
-				left = std::make_shared<FBVH_Node<T>>(objects, start, mid);
-				right = std::make_shared<FBVH_Node<T>>(objects, mid, end);
+				if (bParallel && object_span >= MIN_PARALLEL_BUILD_SPAN)
+				{
+					// the halves are disjoint ranges of objects
+					FParallelSystem& parallel = GlobalParallelSystem();
+					FTaskGroup group;
+					FFunctionTask leftTask([&]() { left = CreateChild(objects, start, mid, lazyDepth, depth + 1, bParallel); });
+
+					parallel.AddTask(&leftTask, &group);
+					right = CreateChild(objects, mid, end, lazyDepth, depth + 1, bParallel);
+					parallel.Wait(group);
+				}
+				else
+				{
+					left = CreateChild(objects, start, mid, lazyDepth, depth + 1, bParallel);
+					right = CreateChild(objects, mid, end, lazyDepth, depth + 1, bParallel);
+				}
 
 				shadow_left = left.get();
 				shadow_right = right.get();
@@ -102,6 +158,46 @@ namespace pbrt
 			return hit_left || hit_right;
 		}
 
+		virtual bool Visit(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+		{
+			if (bbox.Intersect(ray))
+			{
+				// left is popped first, as in Intersect
+				if (shadow_right)
+				{
+					stack.push_back(shadow_right);
+				}
+				stack.push_back(shadow_left);
+			}
+
+			return false;
+		}
+
+		virtual std::shared_ptr<FBVH_NodeBase> Clone() const
+		{
+			std::shared_ptr<FBVH_Node<T>> node(new FBVH_Node<T>());
+			node->bbox = bbox;
+			node->left = left->Clone();
+			node->right = right ? right->Clone() : nullptr;
+			node->shadow_left = node->left.get();
+			node->shadow_right = node->right.get();
+
+			return node;
+		}
+
+	protected:
+		FBVH_Node() {}
+
+		static std::shared_ptr<FBVH_NodeBase> CreateChild(std::vector<T>& objects, size_t start, size_t end, int lazyDepth, int depth, bool bParallel)
+		{
+			if (lazyDepth >= 0 && depth >= lazyDepth && end - start > MAX_HITTABLES_IN_LEAF)
+			{
+				return std::make_shared<FBVH_NodeLazy<T>>(objects, start, end, lazyDepth, bParallel);
+			}
+
+			return std::make_shared<FBVH_Node<T>>(objects, start, end, lazyDepth, depth, bParallel);
+		}
+
 	protected:
 		std::shared_ptr<FBVH_NodeBase> left;
 		std::shared_ptr<FBVH_NodeBase> right;
@@ -141,9 +237,125 @@ namespace pbrt
 			return bHit;
 		}
 
+		virtual bool Visit(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+		{
+			bool bHit = false;
+
+			for (auto obj : objs)
+			{
+				bHit |= obj->Traverse(ray, oisect, stack, visited);
+			}
+
+			return bHit;
+		}
+
+		virtual std::shared_ptr<FBVH_NodeBase> Clone() const
+		{
+			return std::make_shared<FBVH_NodeLeaf<T>>(*this);
+		}
+
 	protected:
 		std::vector<T> objs;
 	};
 
+
+	// unbuilt subtree
+	//   keeps its objects and their bounds only. the first ray entering the box builds the next
+	//   lazyDepth levels (one builder, other threads wait), deeper subtrees stay lazy again.
+	//   the builder is inside a traversal, so it builds on its own thread without parallel tasks
+	template<typename T>
+	class FBVH_NodeLazy : public FBVH_NodeBase
+	{
+	public:
+		// [start, end)
+		FBVH_NodeLazy(std::vector<T>& objects, size_t start, size_t end, int inLazyDepth, bool bParallel = true)
+			: objs(objects.begin() + start, objects.begin() + end)
+			, lazyDepth(std::max(inLazyDepth, 1))
+			, shadow_node(nullptr)
+		{
+			const int64_t chunk = bParallel && objs.size() >= MIN_PARALLEL_BUILD_SPAN ? 0 : objs.size();
+			bbox = ParallelReduce(0, objs.size(), chunk, FBounds3(),
+				[this](int64_t start, int64_t end)
+				{
+					FBounds3 bound;
+					for (int64_t i = start; i < end; ++i)
+					{
+						bound.Expand(objs[i]->WorldBounds());
+					}
+					return bound;
+				},
+				[](const FBounds3& a, const FBounds3& b) { return a.Join(b); });
+		}
+
+		virtual bool Intersect(const FRay& ray, FIntersection& oisect) const
+		{
+			if (!bbox.Intersect(ray))
+				return false;
+
+			return Built()->Intersect(ray, oisect);
+		}
+
+		virtual bool Visit(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+		{
+			if (bbox.Intersect(ray))
+			{
+				stack.push_back(Built());
+			}
+
+			return false;
+		}
+
+		bool IsBuilt() const { return shadow_node.load(std::memory_order_acquire) != nullptr; }
+
+		virtual std::shared_ptr<FBVH_NodeBase> Clone() const
+		{
+			FBVH_NodeBase* built = shadow_node.load(std::memory_order_acquire);
+			if (built)
+				return built->Clone();
+
+			// stays lazy, built by the first ray through the copy
+			std::shared_ptr<FBVH_NodeLazy<T>> node(new FBVH_NodeLazy<T>(objs, lazyDepth));
+			node->bbox = bbox;
+
+			return node;
+		}
+
+	protected:
+		FBVH_NodeLazy(const std::vector<T>& inObjs, int inLazyDepth)
+			: objs(inObjs)
+			, lazyDepth(inLazyDepth)
+			, shadow_node(nullptr)
+		{}
+
+		FBVH_NodeBase* Built() const
+		{
+			FBVH_NodeBase* built = shadow_node.load(std::memory_order_acquire);
+			if (!built)
+			{
+				std::call_once(buildOnce, [this]() { Build(); });
+				built = shadow_node.load(std::memory_order_acquire);
+			}
+
+			return built;
+		}
+
+		void Build() const
+		{
+			node = std::make_shared<FBVH_Node<T>>(objs, 0, objs.size(), lazyDepth, 0, false);
+			shadow_node.store(node.get(), std::memory_order_release);
+
+			// the built nodes hold their own copies
+			std::vector<T>().swap(objs);
+		}
+
+	protected:
+		mutable std::vector<T> objs;
+		int lazyDepth;
+
+		mutable std::once_flag buildOnce;
+		mutable std::shared_ptr<FBVH_NodeBase> node;
+		mutable std::atomic<FBVH_NodeBase*> shadow_node;
+	};
+
 } // namespace pbrt
 
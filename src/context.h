@@ -0,0 +1,64 @@
+// \brief
+//		per thread render state
+//
+
+#pragma once
+
+#include "pbrt.h"
+#include "sampler.h"
+#include "memory.h"
+#include "bvh.h"
+
+
+namespace pbrt
+{
+
+// counters of one render thread, summed when the frame is done
+struct FRenderStats
+{
+	uint64_t cameraRays = 0;
+	uint64_t rays = 0;			// closest hit queries
+	uint64_t shadowRays = 0;	// occlusion queries
+	uint64_t bvhNodes = 0;		// nodes visited by both
+
+	FRenderStats& operator+=(const FRenderStats& other)
+	{
+		cameraRays += other.cameraRays;
+		rays += other.rays;
+		shadowRays += other.shadowRays;
+		bvhNodes += other.bvhNodes;
+		return *this;
+	}
+};
+
+// thread context
+//   everything a render thread needs per sample: its sampler, the arena for bsdfs and other
+//   scratch memory of one sample, the bvh traversal stack and the counters. created once per
+//   worker and never shared, so nothing in here takes a lock. aligned to a cache line so the
+//   counters of two threads never share one.
+class alignas(64) FThreadContext
+{
+public:
+	FThreadContext(std::unique_ptr<FSampler> inSampler)
+		: sampler(std::move(inSampler))
+	{
+		traversalStack.reserve(64);
+	}
+
+	FThreadContext(const FThreadContext&) = delete;
+	FThreadContext& operator=(const FThreadContext&) = delete;
+
+	FSampler* Sampler() const { return sampler.get(); }
+	// reset by the integrator after every sample
+	FMemoryArena& Arena() { return arena; }
+
+public:
+	FRenderStats stats;
+	FBVHStack traversalStack;
+
+protected:
+	std::unique_ptr<FSampler> sampler;
+	FMemoryArena arena;
+};
+
+} // namespace pbrt
@@ -3,6 +3,7 @@
 //
 
 #include "film.h"
+#include "parallel.h"
 
 
 namespace pbrt
@@ -25,6 +26,12 @@ bool FFilm::SaveAsImage(const std::string& filename, EImageType imgType) const
 	{
 		const std::string realname = filename + ".bmp";
 
+		// tiles already encoded during rendering
+		if (encodedPixels.load() == GetPixelsNum())
+		{
+			return WriteBMP(realname, Width(), Height(), Channels(), encoded.data());
+		}
+
 		return SaveAsBMP(realname, Width(), Height(), Channels(), pixels);
 	}
 		break;
@@ -60,6 +67,18 @@ bool FFilm::SaveAsPPM(const std::string& filename, int width, int height, int ch
 }
 
 bool FFilm::SaveAsBMP(const std::string& filename, int width, int height, int channels, const FColor* pColors)
+{
+	std::vector<uint8_t> bgr(width * height * channels);
+
+	ParallelFor(0, height, 0, [&](int64_t y)
+	{
+		EncodeBGR(width, channels, pColors, 0, (int)y, width, (int)y + 1, bgr.data());
+	});
+
+	return WriteBMP(filename, width, height, channels, bgr.data());
+}
+
+bool FFilm::WriteBMP(const std::string& filename, int width, int height, int channels, const uint8_t* pBGR)
 {
 	// https://github.com/SmallVCM/SmallVCM/blob/master/src/framebuffer.hxx#L149-L215
 	// https://github.com/skywind3000/RenderHelp/blob/master/RenderHelp.h#L937-L1018
@@ -113,15 +132,26 @@ bool FFilm::SaveAsBMP(const std::string& filename, int width, int height, int ch
 
 	// 3.without color table
 
-	// 4.write data body 
+	// 4.write data body
+	int line_num = width * channels;
+	std::vector<uint8_t> line(padding_line_bytes, 0);
+	// bmp is stored from bottom to up
+	for (int y = height - 1; y >= 0; --y)
+	{
+		memcpy(line.data(), pBGR + y * line_num, line_num);
+		img_file.write((const char*)line.data(), padding_line_bytes);
+	}
+
+	return true;
+}
+
+void FFilm::EncodeBGR(int width, int channels, const FColor* pColors, int sx, int sy, int ex, int ey, uint8_t* pBGR)
+{
 	// gamma encoding
-	int pixels_num = width * height;
-	int bytes_num = pixels_num * channels;
-	auto bytes = std::make_unique<uint8_t[]>(padding_image_bytes);
-	for (int y = 0; y < height; ++y)
+	for (int y = sy; y < ey; ++y)
 	{
-		uint8_t* pLine = &bytes[0] + (padding_line_bytes * y);
-		for (int x = 0; x < width; ++x)
+		uint8_t* pLine = pBGR + (width * channels * y);
+		for (int x = sx; x < ex; ++x)
 		{
 			int pixel_index = width * y + x;
 			int byte_index = x * channels;
@@ -130,19 +160,22 @@ bool FFilm::SaveAsBMP(const std::string& filename, int width, int height, int ch
 			pLine[byte_index + 1] = gamma_encoding(pColors[pixel_index].g);
 			pLine[byte_index + 2] = gamma_encoding(pColors[pixel_index].r);
 		}
-
-	}
-
-	int line_num = width * channels;
-	// bmp is stored from bottom to up
-	for (int y = height - 1; y >= 0; --y)
-	{
-		img_file.write((const char*)(bytes.get() + y * line_num), line_num);
 	}
+}
 
-	return true;
+void FFilm::ClearEncoded()
+{
+	encoded.resize(GetPixelsNum() * Channels());
+	encodedPixels = 0;
 }
 
+void FFilm::EncodeTile(int sx, int sy, int ex, int ey)
+{
+	PBRT_DOCHECK(encoded.size() == (size_t)(GetPixelsNum() * Channels()));
+
+	EncodeBGR(width, Channels(), pixels, sx, sy, ex, ey, encoded.data());
+	encodedPixels.fetch_add((ex - sx) * (ey - sy));
+}
 
 bool FFilm::SaveAsHDR(const std::string& filename, int width, int height, int channels, const FColor* pColors)
 {
@@ -8,6 +8,8 @@
 #include "color.h"
 #include "geometry.h"
 
+#include <atomic>
+
 
 namespace pbrt
 {
@@ -30,6 +32,7 @@ public:
 	FFilm(int w, int h)
 		: width(w)
 		, height(h)
+		, encodedPixels(0)
 	{
 		pixels = new FColor[GetPixelsNum()];
 	}
@@ -79,18 +82,33 @@ public:
 		{
 			pixels[i] = FColor::Black;
 		}
+
+		ClearEncoded();
 	}
 
+	// gamma encode the finished pixels of [sx, ex) x [sy, ey) for the 8 bit image output,
+	// so tiles can be encoded while others still render. thread safe for disjoint rectangles
+	void EncodeTile(int sx, int sy, int ex, int ey);
+	void ClearEncoded();
+
 	virtual bool SaveAsImage(const std::string& filename, EImageType imgType) const;
 protected:
 	static bool SaveAsPPM(const std::string& filename, int width, int height, int channels, const FColor* pColors);
 	static bool SaveAsBMP(const std::string& filename, int width, int height, int channels, const FColor* pColors);
 	static bool SaveAsHDR(const std::string& filename, int width, int height, int channels, const FColor* pColors);
 
+	// BGR rows, top to bottom, without padding
+	static bool WriteBMP(const std::string& filename, int width, int height, int channels, const uint8_t* pBGR);
+	static void EncodeBGR(int width, int channels, const FColor* pColors, int sx, int sy, int ex, int ey, uint8_t* pBGR);
+
 protected:
 	int width;
 	int height;
 	FColor *pixels;
+
+	// gamma encoded BGR, valid once every pixel has been encoded
+	std::vector<uint8_t> encoded;
+	std::atomic<int> encodedPixels;
 };
 
 // Film View
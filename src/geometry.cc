@@ -29,5 +29,35 @@ namespace pbrt
 		return true;
 	}
 
+	FDirectionCone Union(const FDirectionCone& a, const FDirectionCone& b)
+	{
+		if (a.IsEmpty()) return b;
+		if (b.IsEmpty()) return a;
+
+		// one cone may already hold the other
+		Float theta_a = std::acos(Clamp(a.cosTheta, (Float)-1, (Float)1));
+		Float theta_b = std::acos(Clamp(b.cosTheta, (Float)-1, (Float)1));
+		Float theta_d = std::acos(Clamp(Dot(a.w, b.w), (Float)-1, (Float)1));
+		if (std::min(theta_d + theta_b, kPi) <= theta_a) return a;
+		if (std::min(theta_d + theta_a, kPi) <= theta_b) return b;
+
+		// spread of the new cone, and the angle to rotate a.w by towards b.w
+		Float theta_o = (theta_a + theta_d + theta_b) / 2;
+		if (theta_o >= kPi)
+			return FDirectionCone::EntireSphere();
+
+		Float theta_r = theta_o - theta_a;
+		FVector3 wr = Cross(a.w, b.w);
+		if (wr.Length2() == 0)
+			return FDirectionCone::EntireSphere();
+
+		// rodrigues' rotation of a.w around wr
+		wr = Normalize(wr);
+		Float cosr = std::cos(theta_r), sinr = std::sin(theta_r);
+		FVector3 w = a.w * cosr + Cross(wr, a.w) * sinr + wr * Dot(wr, a.w) * (1 - cosr);
+
+		return FDirectionCone(w, std::cos(theta_o));
+	}
+
 
 } // namespace pbrt
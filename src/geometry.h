@@ -171,6 +171,47 @@ inline Float Distance2(const FPoint3& p1, const FPoint3& p2)
 	return (p1 - p2).Length2();
 }
 
+// octahedral unit vector encoding, 16 bits for each of the two coordinates
+// Cigolle et al., A Survey of Efficient Representations for Independent Unit Vectors, JCGT 2014
+inline Float SignNotZero(Float v) { return (v >= 0) ? (Float)1 : (Float)-1; }
+
+inline uint32_t EncodeOctahedral(const FVector3& n)
+{
+	Float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0))
+		return EncodeOctahedral(FVector3(0, 0, 1));
+
+	Float u = n.x / l1, v = n.y / l1;
+	if (n.z < 0)
+	{
+		// fold the lower hemisphere over the diagonals
+		Float fu = (1 - std::abs(v)) * SignNotZero(u);
+		Float fv = (1 - std::abs(u)) * SignNotZero(v);
+		u = fu;
+		v = fv;
+	}
+
+	uint32_t qu = (uint32_t)std::lround((Clamp(u, -1, 1) * (Float)0.5 + (Float)0.5) * 65535);
+	uint32_t qv = (uint32_t)std::lround((Clamp(v, -1, 1) * (Float)0.5 + (Float)0.5) * 65535);
+	return qu | (qv << 16);
+}
+
+inline FVector3 DecodeOctahedral(uint32_t encoded)
+{
+	Float u = (encoded & 0xffff) * ((Float)2 / 65535) - 1;
+	Float v = (encoded >> 16) * ((Float)2 / 65535) - 1;
+
+	FVector3 n(u, v, 1 - std::abs(u) - std::abs(v));
+	if (n.z < 0)
+	{
+		Float x = n.x;
+		n.x = (1 - std::abs(n.y)) * SignNotZero(x);
+		n.y = (1 - std::abs(x)) * SignNotZero(n.y);
+	}
+
+	return Normalize(n);
+}
+
 
 /*
 	 z(0, 0, 1)
@@ -377,6 +418,37 @@ private:
 	}
 };
 
+
+// direction cone
+//   bounds a set of directions: all w with Dot(w, dir) >= cosTheta. empty while cosTheta is infinite
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/util/vecmath.h (DirectionCone)
+struct FDirectionCone
+{
+	FVector3 w;
+	Float cosTheta;
+
+	FDirectionCone()
+		: w(0, 0, 1)
+		, cosTheta(kInfinity)
+	{}
+
+	FDirectionCone(const FVector3& dir, Float inCosTheta)
+		: w(Normalize(dir))
+		, cosTheta(inCosTheta)
+	{}
+
+	explicit FDirectionCone(const FVector3& dir)
+		: FDirectionCone(dir, 1)
+	{}
+
+	static FDirectionCone EntireSphere() { return FDirectionCone(FVector3(0, 0, 1), -1); }
+
+	bool IsEmpty() const { return cosTheta == kInfinity; }
+
+	// the smallest cone holding both
+	friend FDirectionCone Union(const FDirectionCone& a, const FDirectionCone& b);
+};
+
 // Ray
 // 
 //  ----+-------------+--->
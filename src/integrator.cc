@@ -9,30 +9,7 @@
 namespace pbrt
 {
 
-// Task
-class FRenderTask : public FTask
-{
-public:
-	FRenderTask(const FIntegrator* inIntegrator, const FScene* inScene, const std::shared_ptr<FSampler>& inSampler, const FFilmView &inFilmView)
-		: integrator(inIntegrator)
-		, scene(inScene)
-		, sampler(inSampler)
-		, filmview(inFilmView)
-	{}
-
-	virtual void Execute() override
-	{
-		integrator->DoRender(scene, sampler.get(), &filmview);
-	}
-
-protected:
-	const FIntegrator* integrator;
-	const FScene* scene;
-	std::shared_ptr<FSampler> sampler;
-	FFilmView filmview;
-};
-
-void FIntegrator::Render(const FScene* scene, FSampler* sampler, FFilm* film, int numthreads) const
+void FIntegrator::Render(const FScene* scene, FSampler* sampler, FFilm* film, bool bParallel) const
 {
 	const FVector2 resolution = film->GetResolution();
 	const int width = (int)resolution.x;
@@ -41,51 +18,180 @@ void FIntegrator::Render(const FScene* scene, FSampler* sampler, FFilm* film, in
 	FPerformanceCounter perf;
 	perf.StartPerf();
 
+	FRenderStats stats;
+
 	PBRT_PRINT("start rendering ...\n");
-	if (numthreads < 1)
+	if (!bParallel)
 	{
+		FThreadContext context(sampler->Clone());
+		RequestSamples(scene, context.Sampler());
 		FFilmView filmview(film, 0, 0, width, height);
 
-		DoRender(scene, sampler, &filmview);
+		DoRender(scene, context, &filmview);
+		scene->FinishTile();
+		stats += context.stats;
 	}
 	else
 	{
-		const int lines_per_task = 20;
-		FParallelSystem  parallel;
-		std::vector<std::shared_ptr<FRenderTask>>  tasks;
-		
-		for (int y=0;; y+=lines_per_task)
+		const int tile = ChooseTileSize(width, height, ParallelThreadsNum());
+		const int numx = (width + tile - 1) / tile;
+		const int numy = (height + tile - 1) / tile;
+
+		// one context per worker, allocated by the worker itself on its first tile
+		FParallelSystem& parallel = GlobalParallelSystem();
+		std::vector<std::unique_ptr<FThreadContext>> contexts(parallel.NumThreads() + 1);
+
+		auto ThreadContext = [&]() -> FThreadContext&
 		{
-			if (y >= height) {
-				break;
+			std::unique_ptr<FThreadContext>& context = contexts[parallel.WorkerIndex() + 1];
+			if (!context)
+			{
+				context = std::make_unique<FThreadContext>(sampler->Clone());
+				RequestSamples(scene, context->Sampler());
 			}
 
-			int endy = y + lines_per_task;
-			if (endy > height) { endy = height; }
+			return *context;
+		};
+
+		// tiles are queued in tile order, each tile is encoded for output as soon as it is done
+		FTaskGraph graph;
+		film->ClearEncoded();
+
+		for (int index : OrderTiles(numx, numy))
+		{
+			int x = (index % numx) * tile;
+			int y = (index / numx) * tile;
+			int endx = std::min(x + tile, width);
+			int endy = std::min(y + tile, height);
+
+			FTaskGraph::FNode* render = graph.Add([=, &ThreadContext]()
+			{
+				FFilmView filmview(film, x, y, endx, endy);
 
-			std::shared_ptr<FSampler> dupsampler = sampler->Clone();
-			std::shared_ptr<FRenderTask> task = std::make_shared<FRenderTask>(this, scene, dupsampler, FFilmView(film, 0, y, width, endy));
-			tasks.push_back(task);
+				DoRender(scene, ThreadContext(), &filmview);
+				scene->FinishTile();
+			});
 
-			parallel.AddTask(task.get());
+			graph.Add([=]() { film->EncodeTile(x, y, endx, endy); }, { render });
 		} // end for 
 
-		parallel.Start(numthreads);
-		parallel.WaitForFinish();
+		graph.Wait();
+
+		for (const auto& context : contexts)
+		{
+			if (context)
+			{
+				stats += context->stats;
+			}
+		}
 	}
 
-	double elapse = perf.EndPerf();
+	PrintRenderStats(stats, perf.EndPerf());
+}
+
+void FIntegrator::PrintRenderStats(const FRenderStats& stats, double elapse)
+{
 	PBRT_PRINT("finish rendering ...\n");
 	PBRT_PRINT("FIntegrator::Render used %f seconds.\n", (float)(elapse / 1000000.0));
+	PBRT_PRINT("camera rays %llu, rays %llu, shadow rays %llu, %.1f bvh nodes per ray\n",
+		(unsigned long long)stats.cameraRays, (unsigned long long)stats.rays, (unsigned long long)stats.shadowRays,
+		(double)stats.bvhNodes / std::max<uint64_t>(stats.rays + stats.shadowRays, 1));
+}
+
+int FIntegrator::ChooseTileSize(int width, int height, int numthreads) const
+{
+	if (tileSize > 0)
+		return tileSize;
+
+	// the largest tile that still leaves every thread enough tiles to balance the load
+	const int min_tiles_per_thread = 8;
+	for (int size = 32; size > 8; size /= 2)
+	{
+		int num = ((width + size - 1) / size) * ((height + size - 1) / size);
+		if (num >= min_tiles_per_thread * numthreads)
+			return size;
+	}
+
+	return 8;
+}
+
+// distance of (x, y) along the hilbert curve filling a n x n grid, n is a power of 2
+static int HilbertIndex(int n, int x, int y)
+{
+	int d = 0;
+	for (int s = n / 2; s > 0; s /= 2)
+	{
+		int rx = (x & s) > 0;
+		int ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+
+		// rotate the quadrant
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	} // end for s
+
+	return d;
 }
 
-void FIntegrator::DoRender(const FScene* scene, FSampler* sampler, FFilmView* filmview) const
+std::vector<int> FIntegrator::OrderTiles(int numx, int numy) const
+{
+	std::vector<int> order(numx * numy);
+	for (int i = 0; i < numx * numy; ++i)
+	{
+		order[i] = i;
+	}
+
+	if (tileOrder == TileOrderHilbert)
+	{
+		int n = 1;
+		while (n < numx || n < numy) { n *= 2; }
+
+		std::vector<int> key(numx * numy);
+		for (int i = 0; i < numx * numy; ++i)
+		{
+			key[i] = HilbertIndex(n, i % numx, i / numx);
+		}
+
+		std::sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] < key[b]; });
+	}
+	else if (tileOrder == TileOrderSpiral)
+	{
+		// rings of growing chebyshev distance from the center tile, each ring walked by angle
+		const Float cx = (numx - 1) * 0.5f;
+		const Float cy = (numy - 1) * 0.5f;
+
+		std::vector<std::pair<Float, Float>> key(numx * numy);
+		for (int i = 0; i < numx * numy; ++i)
+		{
+			Float dx = (i % numx) - cx;
+			Float dy = (i / numx) - cy;
+			key[i] = std::make_pair(std::floor(std::max(std::abs(dx), std::abs(dy))), std::atan2(dy, dx));
+		}
+
+		std::sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] < key[b]; });
+	}
+
+	return order;
+}
+
+void FIntegrator::DoRender(const FScene* scene, FThreadContext& context, FFilmView* filmview) const
 {
 	const FCamera* pCamera = scene->Camera();
 	int startx, starty, endx, endy;
 
 	filmview->GetViewport(startx, starty, endx, endy);
 
+	FSampler* sampler = context.Sampler();
+	// bsdfs of one sample, recycled after it
+	FMemoryArena& arena = context.Arena();
+
 	Float ratio = (Float)1 / sampler->GetSamplesPerPixel();
 	for (int y = starty; y < endy; y++)
 	{
@@ -93,13 +199,15 @@ void FIntegrator::DoRender(const FScene* scene, FSampler* sampler, FFilmView* fi
 		{
 			FColor L;
 
-			sampler->StartPixel();
+			sampler->StartPixel(x, y);
 
 			do
 			{
 				auto camera_sample = sampler->GetCameraSample(FPoint2((Float)x, (Float)y));
 				FRay ray = pCamera->GenerateRay(camera_sample);
-				FColor dL = Li(ray, scene, sampler) * ratio;
+				++context.stats.cameraRays;
+				FColor dL = Li(ray, scene, context) * ratio;
+				arena.Reset();
 
 				PBRT_DOCHECK(dL.IsValid());
 				L += dL;
@@ -110,15 +218,88 @@ void FIntegrator::DoRender(const FScene* scene, FSampler* sampler, FFilmView* fi
 	} // end y
 }
 
+void FIntegrator::RequestLightSamples(const FScene* scene, FSampler* sampler) const
+{
+	if (scene->LightSamplesNum() > 1)
+	{
+		const int n = sampler->RoundCount(scene->LightSamplesNum());
+		sampler->Request1DArray(n);
+		sampler->Request2DArray(n);
+	}
+}
+
+FColor FIntegrator::SampleLights(const FIntersection& isect, const FBSDF* bsdf, const FScene* scene, FThreadContext& context, bool bUseArrays, bool bMIS, int* out_samplesNum) const
+{
+	FSampler* sampler = context.Sampler();
+	const FLightSampler* lightSampler = scene->LightSampler();
+
+	int n = 1;
+	const Float* lightSamples = nullptr;
+	const FFloat2* samples = nullptr;
+	if (bUseArrays && scene->LightSamplesNum() > 1)
+	{
+		n = sampler->RoundCount(scene->LightSamplesNum());
+		lightSamples = sampler->Get1DArray(n);
+		samples = sampler->Get2DArray(n);
+	}
+
+	if (!lightSamples || !samples)
+	{
+		n = 1;
+		lightSamples = nullptr;
+		samples = nullptr;
+	}
+
+	if (out_samplesNum)
+	{
+		*out_samplesNum = n;
+	}
+
+	FColor L(0, 0, 0);
+	for (int i = 0; i < n; ++i)
+	{
+		// pick one light, its pmf is part of the sample pdf
+		Float ulight = lightSamples ? lightSamples[i] : sampler->GetFloat();
+		FFloat2 u = samples ? samples[i] : sampler->GetFloat2();
+
+		FSampledLight sampled = lightSampler->Sample(isect, ulight);
+		if (!sampled.light || sampled.pmf == 0) {
+			continue;
+		}
+
+		const FLight* light = sampled.light;
+		FLightSample lightsample = light->Sample_Li(isect, u);
+		if (lightsample.Li.IsBlack() || lightsample.pdf == (Float)0) {
+			continue;
+		}
+
+		const Float pdf = sampled.pmf * lightsample.pdf;
+		FColor f = bsdf->Evalf(isect.wo, lightsample.wi);
+		if (!f.IsBlack() && !scene->Occluded(isect, lightsample.pos, context))
+		{
+			// a delta light can't be hit by a bsdf sample
+			Float weight = 1;
+			if (bMIS && !light->IsDelta())
+			{
+				weight = power_heuristic(n, pdf, 1, bsdf->Pdf(isect.wo, lightsample.wi));
+			}
+
+			L += f * lightsample.Li * AbsDot(lightsample.wi, isect.normal) * weight / pdf;
+		}
+	} // end for i
+
+	return L / (Float)n;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Whitted Integrator
-FColor FWhittedIntegrator::Li(const FRay& ray, const FScene* scene, FSampler* sampler, int depth) const
+FColor FWhittedIntegrator::Li(const FRay& ray, const FScene* scene, FThreadContext& context, int depth) const
 {
 	FColor L(0,0,0);
 
 	// Find closest ray intersection or return background radiance
 	FIntersection isect;
-	bool bHit = scene->Intersect(ray, isect);
+	bool bHit = scene->Intersect(ray, isect, context);
 	if (!bHit)
 	{
 		for (const auto& light : scene->InfiniteLights())
@@ -128,47 +309,32 @@ FColor FWhittedIntegrator::Li(const FRay& ray, const FScene* scene, FSampler* sa
 	}
 
 	// Compute emitted and reflected light at ray intersection point
-	// Initialize common variables for Whitted integrator
-	const FNormal3& N = isect.normal;
-
 	// Compute scattering function for surface interaction
-	std::unique_ptr<FBSDF> bsdfptr = isect.Bsdf(sampler);
+	FBSDF* bsdfptr = isect.Bsdf(*scene, context.Sampler(), context.Arena());
 	if (!bsdfptr) {
-		return Li(isect.SpawnRay(ray.Dir()), scene, sampler, depth);
+		return Li(isect.SpawnRay(ray.Dir()), scene, context, depth);
 	}
 
 	// Compute emitted light if ray hit an area light source
-	L += isect.Le();
+	L += isect.Le(*scene);
 
 	// Add contribution of each light source
-	for (const auto& light : scene->Lights())
-	{
-		FLightSample lightsample = light->Sample_Li(isect, sampler->GetFloat2());
-		if (lightsample.Li.IsBlack() || lightsample.pdf == (Float)0) {
-			continue;
-		}
-
-		FColor f = bsdfptr->Evalf(isect.wo, lightsample.wi);
-		if (!f.IsBlack() && !scene->Occluded(isect, lightsample.pos))
-		{
-			L += f * lightsample.Li * AbsDot(lightsample.wi, N) / lightsample.pdf;
-		}
-	} // end for 
+	L += SampleLights(isect, bsdfptr, scene, context, depth == 0);
 
 	// reflect & transmit
 	if (depth + 1 < maxDepth)
 	{
 		// Trace rays for specular reflection and refraction
-		L += SpecularReflect(ray, isect, bsdfptr.get(), scene, sampler, depth);
-		L += SpecularTransmit(ray, isect, bsdfptr.get(), scene, sampler, depth);
-		L += SpecularReflectAndTransmit(ray, isect, bsdfptr.get(), scene, sampler, depth);
+		L += SpecularReflect(ray, isect, bsdfptr, scene, context, depth);
+		L += SpecularTransmit(ray, isect, bsdfptr, scene, context, depth);
+		L += SpecularReflectAndTransmit(ray, isect, bsdfptr, scene, context, depth);
 	}
 
 	return L;
 }
 
 
-FColor FWhittedIntegrator::SpecularReflect(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const
+FColor FWhittedIntegrator::SpecularReflect(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const
 {
 	const int matchFlags = eBSDFType::Specular | eBSDFType::Reflection;
 
@@ -177,15 +343,15 @@ FColor FWhittedIntegrator::SpecularReflect(const FRay& ray, const FIntersection&
 		return FColor::Black;
 	}
 
-	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, sampler->GetFloat2());
+	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
 	if (bsdfsample.f.IsBlack() || bsdfsample.pdf == 0.f)
 	{
 		return FColor::Black;
 	}
-	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, sampler, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
+	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, context, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
 }
 
-FColor FWhittedIntegrator::SpecularTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const
+FColor FWhittedIntegrator::SpecularTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const
 {
 	const int matchFlags = eBSDFType::Specular | eBSDFType::Transmission;
 
@@ -194,15 +360,15 @@ FColor FWhittedIntegrator::SpecularTransmit(const FRay& ray, const FIntersection
 		return FColor::Black;
 	}
 
-	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, sampler->GetFloat2());
+	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
 	if (bsdfsample.f.IsBlack() || bsdfsample.pdf == 0.f)
 	{
 		return FColor::Black;
 	}
-	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, sampler, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
+	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, context, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
 }
 
-FColor FWhittedIntegrator::SpecularReflectAndTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const
+FColor FWhittedIntegrator::SpecularReflectAndTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const
 {
 	const int matchFlags = eBSDFType::Specular | eBSDFType::Reflection | eBSDFType::Transmission;
 
@@ -211,12 +377,12 @@ FColor FWhittedIntegrator::SpecularReflectAndTransmit(const FRay& ray, const FIn
 		return FColor::Black;
 	}
 
-	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, sampler->GetFloat2());
+	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
 	if (bsdfsample.f.IsBlack() ||  bsdfsample.pdf == 0.f)
 	{
 		return FColor::Black;
 	}
-	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, sampler, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
+	return bsdfsample.f * Li(isect.SpawnRay(bsdfsample.wi), scene, context, depth + 1) * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -230,17 +396,17 @@ FColor FWhittedIntegrator::SpecularReflectAndTransmit(const FRay& ray, const FIn
 //         = Le + Le + (Le + (Le + (Li)))
 //         = Le + Le + (Le + (Le + (Le + ...))) < --LOOK THIS
 
-FColor FPathIntegratorRecursive::Li(const FRay& ray, const FScene* scene, FSampler* sampler, int depth, bool is_prev_specular) const
+FColor FPathIntegratorRecursive::Li(const FRay& ray, const FScene* scene, FThreadContext& context, int depth, bool is_prev_specular) const
 {
 	FColor L(0, 0, 0);
 
 	// Find closest ray intersection or return background radiance
 	FIntersection isect;
-	bool bFoundIntersection = scene->Intersect(ray, isect);
+	bool bFoundIntersection = scene->Intersect(ray, isect, context);
 	if (depth == 0 || is_prev_specular)
 	{
 		if (bFoundIntersection) {
-			L += isect.Le();
+			L += isect.Le(*scene);
 		}
 		else {
 			for (const auto& light : scene->InfiniteLights())
@@ -254,35 +420,21 @@ FColor FPathIntegratorRecursive::Li(const FRay& ray, const FScene* scene, FSampl
 		return L;
 	}
 
-	const FNormal3& N = isect.normal;
-
 	// Compute scattering function for surface interaction
-	std::unique_ptr<FBSDF> bsdfptr = isect.Bsdf(sampler);
+	FBSDF* bsdfptr = isect.Bsdf(*scene, context.Sampler(), context.Arena());
 	if (!bsdfptr) {
-		return Li(isect.SpawnRay(ray.Dir()), scene, sampler, depth, is_prev_specular);
+		return Li(isect.SpawnRay(ray.Dir()), scene, context, depth, is_prev_specular);
 	}
 
 	// Sample illumination from lights to find path contribution.
 	// (But skip this for perfectly specular BSDFs.)
 	if (!bsdfptr->IsDelta())
 	{
-		for (const auto& light : scene->Lights())
-		{
-			FLightSample lightsample = light->Sample_Li(isect, sampler->GetFloat2());
-			if (lightsample.Li.IsBlack() || lightsample.pdf == (Float)0) {
-				continue;
-			}
-
-			FColor f = bsdfptr->Evalf(isect.wo, lightsample.wi);
-			if (!f.IsBlack() && !scene->Occluded(isect, lightsample.pos))
-			{
-				L += f * lightsample.Li * AbsDot(lightsample.wi, N) / lightsample.pdf;
-			}
-		} // end for 
+		L += SampleLights(isect, bsdfptr, scene, context, depth == 0);
 	}
 	
 	// Sample BSDF to get new path direction
-	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, sampler->GetFloat2());
+	FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
 	if (bsdfsample.f.IsBlack() || bsdfsample.pdf == 0.f)
 	{
 		return L;
@@ -292,17 +444,17 @@ FColor FPathIntegratorRecursive::Li(const FRay& ray, const FScene* scene, FSampl
 	if (depth >= 3)
 	{
 		Float q = std::max((Float)0.05, 1 - bsdfsample.f.MaxComponentValue());
-		if (sampler->GetFloat() < q)
+		if (context.Sampler()->GetFloat() < q)
 		{
 			return L;
 		}
 
-		L += bsdfsample.f * AbsDot(bsdfsample.wi, isect.normal) * Li(isect.SpawnRay(bsdfsample.wi), scene, sampler, depth + 1, bsdfptr->IsDelta()) / (bsdfsample.pdf * (1 - q));
+		L += bsdfsample.f * AbsDot(bsdfsample.wi, isect.normal) * Li(isect.SpawnRay(bsdfsample.wi), scene, context, depth + 1, bsdfptr->IsDelta()) / (bsdfsample.pdf * (1 - q));
 		return L;
 	}
 
 	// for first 3 paths.
-	L += bsdfsample.f * AbsDot(bsdfsample.wi, isect.normal) * Li(isect.SpawnRay(bsdfsample.wi), scene, sampler, depth + 1, bsdfptr->IsDelta()) / bsdfsample.pdf;
+	L += bsdfsample.f * AbsDot(bsdfsample.wi, isect.normal) * Li(isect.SpawnRay(bsdfsample.wi), scene, context, depth + 1, bsdfptr->IsDelta()) / bsdfsample.pdf;
 	return L;
 }
 
@@ -313,28 +465,51 @@ FColor FPathIntegratorRecursive::Li(const FRay& ray, const FScene* scene, FSampl
 //  Li = Le + T*Le + T*(T*Le + T*(T*Le + ...))
 //	   = Le + T*Le + T^2*Le  + ...
 //
-FColor FPathIntegratorIteration::Li(const FRay& inRay, const FScene* scene, FSampler* sampler) const
+//  the direct light of every vertex is estimated twice: by sampling the lights, and by the emission
+//  the bsdf sampled ray of the next bounce hits. both are weighted by the power heuristic (MIS),
+//  so glossy surfaces take the bsdf samples and diffuse ones the light samples.
+//
+// https://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/Importance_Sampling#MultipleImportanceSampling
+FColor FPathIntegratorIteration::Li(const FRay& inRay, const FScene* scene, FThreadContext& context) const
 {
 	FColor L(0, 0, 0),  beta(1, 1, 1);
 	FRay ray(inRay);
 	bool bSpecularBounce = false;
 	int bounces;
 
+	// the last scattering vertex, the pdf of the bsdf sample leaving it and the light samples it took
+	FIntersection prevIsect;
+	Float bsdfPdf = 0;
+	int lightSamplesNum = 1;
+
+	// weight of emission L reached by the bsdf sample against sampling light
+	auto WeightedLe = [&](const FLight* light, const FColor& Le) -> FColor
+	{
+		if (bounces == 0 || bSpecularBounce || Le.IsBlack())
+			return Le;
+
+		Float lightPdf = scene->LightSampler()->PMF(prevIsect, light) * light->Pdf_Li(prevIsect, ray.Dir());
+		return Le * power_heuristic(1, bsdfPdf, lightSamplesNum, lightPdf);
+	};
+
 	for (bounces = 0; ; ++bounces)
 	{
 		// Find closest ray intersection or return background radiance
 		FIntersection isect;
-		bool bFoundIntersection = scene->Intersect(ray, isect);
-		if (bounces == 0 || bSpecularBounce)
+		bool bFoundIntersection = scene->Intersect(ray, isect, context);
+		if (bFoundIntersection)
 		{
-			if (bFoundIntersection) {
-				L += beta * isect.Le();
-			}
-			else {
-				for (const auto& light : scene->InfiniteLights())
-					L += beta * light->Le(ray);
+			const FAreaLight* arealight = isect.AreaLight(*scene);
+			if (arealight)
+			{
+				L += beta * WeightedLe(arealight, isect.Le(*scene));
 			}
 		}
+		else
+		{
+			for (const auto& light : scene->InfiniteLights())
+				L += beta * WeightedLe(light, light->Le(ray));
+		}
 
 		// Terminate path if ray escaped or _maxDepth_ was reached
 		if (!bFoundIntersection || bounces >= maxDepth)
@@ -342,10 +517,8 @@ FColor FPathIntegratorIteration::Li(const FRay& inRay, const FScene* scene, FSam
 			break;
 		}
 
-		const FNormal3& N = isect.normal;
-
 		// Compute scattering function for surface interaction
-		std::unique_ptr<FBSDF> bsdfptr = isect.Bsdf(sampler);
+		FBSDF* bsdfptr = isect.Bsdf(*scene, context.Sampler(), context.Arena());
 		if (!bsdfptr) {
 			ray = isect.SpawnRay(ray.Dir());
 			--bounces;
@@ -354,36 +527,27 @@ FColor FPathIntegratorIteration::Li(const FRay& inRay, const FScene* scene, FSam
 
 		// Sample illumination from lights to find path contribution.
 		// (But skip this for perfectly specular BSDFs.)
+		lightSamplesNum = 1;
 		if (!bsdfptr->IsDelta())
 		{
-			for (const auto& light : scene->Lights())
-			{
-				FLightSample lightsample = light->Sample_Li(isect, sampler->GetFloat2());
-				if (lightsample.Li.IsBlack() || lightsample.pdf == (Float)0) {
-					continue;
-				}
-
-				FColor f = bsdfptr->Evalf(isect.wo, lightsample.wi);
-				if (!f.IsBlack() && !scene->Occluded(isect, lightsample.pos))
-				{
-					L += beta * f * lightsample.Li * AbsDot(lightsample.wi, N) / lightsample.pdf;
-				}
-			} // end for 
+			L += beta * SampleLights(isect, bsdfptr, scene, context, bounces == 0, true, &lightSamplesNum);
 		}
 
 		// Sample BSDF to get new path direction
-		FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, sampler->GetFloat2());
+		FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
 		if (bsdfsample.f.IsBlack() || bsdfsample.pdf == 0.f)
 		{
 			break;
 		}
 
 		bSpecularBounce = bsdfsample.ebsdf & eBSDFType::Specular;
+		bsdfPdf = bsdfsample.pdf;
+		prevIsect = isect;
 		// Possibly terminate the path with Russian roulette.
 		if (bounces >= 3)
 		{
 			Float q = std::max((Float)0.05, 1 - bsdfsample.f.MaxComponentValue());
-			if (sampler->GetFloat() < q)
+			if (context.Sampler()->GetFloat() < q)
 			{
 				break;
 			}
@@ -2,6 +2,8 @@
 //		integrator
 //
 
+#pragma once
+
 /*
   Li = Lo = Le + Li
           = Le + (Le + Li)
@@ -14,11 +16,20 @@
 #include "pbrt.h"
 #include "scene.h"
 #include "film.h"
+#include "context.h"
 
 
 namespace pbrt
 {
 
+// order in which the image tiles are handed to the render threads
+enum eTileOrder
+{
+    TileOrderScanline = 0,
+    TileOrderHilbert,
+    TileOrderSpiral,		// center out
+};
+
 
  /*
   rendering scene by Rendering Equation(Li = Lo = Le + Li)
@@ -27,16 +38,45 @@ namespace pbrt
 class FIntegrator
 {
 public:
+    FIntegrator()
+        : tileSize(0)
+        , tileOrder(TileOrderHilbert)
+    {}
     virtual ~FIntegrator() {}
 
-    void Render(const FScene* scene, FSampler* sampler, FFilm* film, int numthreads = 1) const;
+    // square tile size in pixels, 0 chooses it from the resolution and thread count
+    void SetTileSize(int size) { tileSize = size; }
+    void SetTileOrder(eTileOrder order) { tileOrder = order; }
+
+    // bParallel renders the tiles on the global parallel system, otherwise on the calling thread
+    virtual void Render(const FScene* scene, FSampler* sampler, FFilm* film, bool bParallel = true) const;
 
 protected:
-    void DoRender(const FScene* scene, FSampler* sampler, FFilmView *filmview) const;
+    static void PrintRenderStats(const FRenderStats& stats, double elapse);
 
-    virtual FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler) const = 0;
+    // called with the sampler of every render thread before its first pixel
+    virtual void RequestSamples(const FScene* scene, FSampler* sampler) const {}
 
-    friend class FRenderTask;
+    void DoRender(const FScene* scene, FThreadContext& context, FFilmView *filmview) const;
+
+    // the light and position arrays of the first vertex, when a light takes more than one sample
+    void RequestLightSamples(const FScene* scene, FSampler* sampler) const;
+    // direct light at isect, without the throughput: one light picked by the scene's light sampler.
+    // with bUseArrays the estimate averages scene->LightSamplesNum() picks from the requested arrays,
+    // only use it once per camera ray. with bMIS the light samples are weighted against sampling the
+    // bsdf, the caller adds the bsdf sampled emission. out_samplesNum is the number of picks taken,
+    // 1 when the arrays were not available
+    FColor SampleLights(const FIntersection& isect, const FBSDF* bsdf, const FScene* scene, FThreadContext& context, bool bUseArrays, bool bMIS = false, int* out_samplesNum = nullptr) const;
+
+    int ChooseTileSize(int width, int height, int numthreads) const;
+    // indices (y * numx + x) of the tiles in render order
+    std::vector<int> OrderTiles(int numx, int numy) const;
+
+    virtual FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const = 0;
+
+protected:
+    int tileSize;
+    eTileOrder tileOrder;
 };
 
 
@@ -44,10 +84,10 @@ protected:
 class FDebugIntegrator : public FIntegrator
 {
 public:
-	FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler) const override
+	FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const override
 	{
 		FIntersection isect;
-		if (scene->Intersect(ray, isect))
+		if (scene->Intersect(ray, isect, context))
 		{
             return isect.normal;
             return FColor(std::abs(isect.normal.x), std::abs(isect.normal.y), std::abs(isect.normal.z));
@@ -67,17 +107,22 @@ public:
 	{
 	}
 
-    FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler) const override
+    FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const override
     {
-        return Li(ray, scene, sampler, 0);
+        return Li(ray, scene, context, 0);
     }
 
 protected:
-    FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler, int depth) const;
+    void RequestSamples(const FScene* scene, FSampler* sampler) const override
+    {
+        RequestLightSamples(scene, sampler);
+    }
+
+    FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context, int depth) const;
 
-    FColor SpecularReflect(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const;
-    FColor SpecularTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const;
-	FColor SpecularReflectAndTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FSampler* sampler, int depth) const;
+    FColor SpecularReflect(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const;
+    FColor SpecularTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const;
+	FColor SpecularReflectAndTransmit(const FRay& ray, const FIntersection& isect, const FBSDF* bsdfptr, const FScene* scene, FThreadContext& context, int depth) const;
 
 protected:
 	int maxDepth;
@@ -92,13 +137,18 @@ public:
 	{
 	}
 
-	FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler) const override
+	FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const override
 	{
-		return Li(ray, scene, sampler, 0, false);
+		return Li(ray, scene, context, 0, false);
 	}
 
 protected:
-	FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler, int depth, bool is_prev_specular) const;
+	void RequestSamples(const FScene* scene, FSampler* sampler) const override
+	{
+		RequestLightSamples(scene, sampler);
+	}
+
+	FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context, int depth, bool is_prev_specular) const;
 
 protected:
 	int maxDepth;
@@ -114,7 +164,13 @@ public:
 	{
 	}
 
-	FColor Li(const FRay& ray, const FScene* scene, FSampler* sampler) const override;
+	FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const override;
+
+protected:
+	void RequestSamples(const FScene* scene, FSampler* sampler) const override
+	{
+		RequestLightSamples(scene, sampler);
+	}
 
 protected:
 	int maxDepth;
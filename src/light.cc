@@ -5,10 +5,84 @@
 #include "light.h"
 #include "scene.h"
 
+#include "../external/stb_image.h"
+
 
 namespace pbrt
 {
 
+static Float SafeSqrt(Float x)
+{
+	return std::sqrt(std::max(x, (Float)0));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static Float CosSubClamped(Float sinTheta_a, Float cosTheta_a, Float sinTheta_b, Float cosTheta_b)
+{
+	if (cosTheta_a > cosTheta_b)
+		return 1;
+	return cosTheta_a * cosTheta_b + sinTheta_a * sinTheta_b;
+}
+
+static Float SinSubClamped(Float sinTheta_a, Float cosTheta_a, Float sinTheta_b, Float cosTheta_b)
+{
+	if (cosTheta_a > cosTheta_b)
+		return 0;
+	return sinTheta_a * cosTheta_b - cosTheta_a * sinTheta_b;
+}
+
+Float FLightBounds::Importance(const FPoint3& p, const FNormal3& n) const
+{
+	// distance to the center, clamped to the size of the bounds so points inside don't blow up
+	FPoint3 pc = Centroid();
+	Float d2 = Distance2(p, pc);
+	d2 = std::max(d2, (bounds._max - bounds._min).Length() / 2);
+
+	// angle between w and the direction to p, minus the spread of the normals
+	FVector3 wi = Normalize(p - pc);
+	Float cosTheta_w = Dot(w, wi);
+	if (bTwoSided)
+		cosTheta_w = std::abs(cosTheta_w);
+	Float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+	// minus the angle the bounds subtend from p
+	FPoint3 center;
+	Float radius;
+	bounds.BoundingSphere(center, radius);
+	Float cosTheta_b = -1;
+	if (Distance2(p, center) > radius * radius)
+	{
+		cosTheta_b = SafeSqrt(1 - radius * radius / Distance2(p, center));
+	}
+	Float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+	Float sinTheta_o = SafeSqrt(1 - cosTheta_o * cosTheta_o);
+	Float cosTheta_x = CosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+	Float sinTheta_x = SinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+	Float cosThetap = CosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+	if (cosThetap <= cosTheta_e)
+		return 0;
+
+	Float importance = phi * cosThetap / d2;
+
+	// the smallest incident angle at p
+	Float cosTheta_i = AbsDot(wi, n);
+	Float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+	importance *= CosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+
+	return std::max(importance, (Float)0);
+}
+
+FLightBounds Union(const FLightBounds& a, const FLightBounds& b)
+{
+	if (a.phi == 0) return b;
+	if (b.phi == 0) return a;
+
+	FDirectionCone cone = Union(FDirectionCone(a.w, a.cosTheta_o), FDirectionCone(b.w, b.cosTheta_o));
+	return FLightBounds(Join(a.bounds, b.bounds), cone.w, a.phi + b.phi, cone.cosTheta,
+		std::min(a.cosTheta_e, b.cosTheta_e), a.bTwoSided || b.bTwoSided);
+}
+
 void FLight::Preprocess(const FScene& scene)
 {
 		// do nothing
@@ -23,6 +97,11 @@ void FDirectionLight::Preprocess(const FScene& scene)
 	power = irradiance * area;
 }
 
+void FAreaLight::Preprocess(const FScene& scene)
+{
+	sampling = scene.AreaLightSampling();
+}
+
 void FEnvironmentLight::Preprocess(const FScene& scene)
 {
 	FBounds3 bound = scene.WorldBound();
@@ -32,5 +111,93 @@ void FEnvironmentLight::Preprocess(const FScene& scene)
 	power = radiance * area;
 }
 
+FEnvironmentMapLight::FEnvironmentMapLight(const FPoint3& worldpos, int samplesNum, const std::string& filename, const FColor& scale, const FFrame& frame)
+	: FLight(eLightFlags::InfiniteLight, worldpos, samplesNum)
+	, width(0)
+	, height(0)
+	, scale(scale)
+	, frame(frame)
+	, worldRadius(0)
+{
+	// linear floats, ldr images are converted from srgb
+	int components = 3;
+	float* data = stbi_loadf(filename.c_str(), &width, &height, &components, 3);
+	if (data)
+	{
+		pixels.resize(width * height);
+		for (int i = 0; i < width * height; ++i)
+		{
+			pixels[i] = FColor(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]);
+		}
+
+		stbi_image_free(data);
+	}
+	else
+	{
+		std::cerr << "ERROR: Could not load environment map " << filename << ".\n";
+
+		// one black pixel, no power so the light samplers skip it
+		width = height = 1;
+		pixels.assign(1, FColor::Black);
+	}
+
+	// the sampling density of a pixel is its luminance times the solid angle it covers
+	std::vector<Float> func(width * height);
+	double weights = 0;
+	for (int y = 0; y < height; ++y)
+	{
+		Float sinTheta = std::sin(kPi * (y + (Float)0.5) / height);
+		for (int x = 0; x < width; ++x)
+		{
+			const FColor L = pixels[y * width + x] * scale;
+			func[y * width + x] = L.Luminance() * sinTheta;
+			average += L * sinTheta;
+			weights += sinTheta;
+		}
+	} // end for y
+
+	average = average / (Float)weights;
+	distribution = std::make_unique<FDistribution2D>(func.data(), width, height);
+}
+
+void FEnvironmentMapLight::Preprocess(const FScene& scene)
+{
+	scene.WorldBound().BoundingSphere(worldCenter, worldRadius);
+	power = average * kPi * worldRadius * worldRadius;
+}
+
+FLightSample FEnvironmentMapLight::Sample_Li(const FIntersection& isect, const FFloat2& uv) const
+{
+	FLightSample sample;
+
+	Float mapPdf;
+	FPoint2 st = distribution->SampleContinuous(uv, &mapPdf);
+	if (mapPdf == 0)
+		return sample;
+
+	// map coordinates to direction, the pdf changes by the jacobian 2pi^2 sin(theta)
+	Float theta = st[1] * kPi, phi = st[0] * k2Pi;
+	Float sinTheta = std::sin(theta);
+	if (sinTheta == 0)
+		return sample;
+
+	sample.wi = frame.ToWorld(Spherical_2_Direction(sinTheta, std::cos(theta), phi));
+	sample.pos = isect.position + sample.wi * 2 * worldRadius;
+	sample.pdf = mapPdf / (2 * kPi * kPi * sinTheta);
+	sample.Li = Lookup(st);
+
+	return sample;
+}
+
+Float FEnvironmentMapLight::Pdf_Li(const FIntersection& isect, const FVector3& world_wi) const
+{
+	FPoint2 st = DirectionToMap(world_wi);
+	Float sinTheta = std::sin(st[1] * kPi);
+	if (sinTheta == 0)
+		return 0;
+
+	return distribution->Pdf(st) / (2 * kPi * kPi * sinTheta);
+}
+
 
 } // namespace pbrt
@@ -8,6 +8,7 @@
 #include "geometry.h"
 #include "color.h"
 #include "shape.h"
+#include "sampling.h"
 
 
 namespace pbrt
@@ -31,6 +32,7 @@ inline bool is_delta_light(int lightFlags)
 struct FLightSample
 {
 	FPoint3		pos;
+	FNormal3	normal;		// at pos, area lights only
 	FVector3	wi;
 	Float		pdf;
 	FColor		Li;
@@ -46,6 +48,46 @@ struct FLightSample
 
 class FScene;
 
+// light bounds
+//   a conservative bound of where and in which directions a light or a group of lights emits, used by
+//   the light bvh to estimate the contribution at a point. emission leaves the bounds in directions
+//   within cosTheta_o of w, and spreads up to cosTheta_e beyond that (pi/2 for a diffuse surface).
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/lights.h (LightBounds)
+struct FLightBounds
+{
+	FBounds3 bounds;
+	FVector3 w;
+	Float	 phi;			// emitted power
+	Float	 cosTheta_o;
+	Float	 cosTheta_e;
+	bool	 bTwoSided;
+
+	FLightBounds()
+		: w(0, 0, 1)
+		, phi(0)
+		, cosTheta_o(1)
+		, cosTheta_e(1)
+		, bTwoSided(false)
+	{}
+
+	FLightBounds(const FBounds3& inBounds, const FVector3& inW, Float inPhi, Float inCosTheta_o, Float inCosTheta_e, bool inTwoSided)
+		: bounds(inBounds)
+		, w(Normalize(inW))
+		, phi(inPhi)
+		, cosTheta_o(inCosTheta_o)
+		, cosTheta_e(inCosTheta_e)
+		, bTwoSided(inTwoSided)
+	{}
+
+	FPoint3 Centroid() const { return Lerp(bounds._min, bounds._max, (Float)0.5); }
+
+	// estimated contribution at point p with surface normal n: power over the squared distance,
+	// times the cosines of the smallest angles the bounds allow
+	Float Importance(const FPoint3& p, const FNormal3& n) const;
+
+	friend FLightBounds Union(const FLightBounds& a, const FLightBounds& b);
+};
+
 // Light
 class FLight
 {
@@ -59,6 +101,8 @@ public:
 	{}
 
 	int Flags() const { return lightFlags; }
+	// samples per estimate of the direct light
+	int SamplesNum() const { return samplesNum; }
 	virtual bool IsDelta() const = 0;
 	virtual bool IsFinite() const = 0;
 
@@ -71,6 +115,9 @@ public:
 	virtual FLightSample Sample_Li(const FIntersection& isect, const FFloat2& random) const = 0;
 	virtual Float Pdf_Li(const FIntersection& isect, const FVector3& world_wi) const = 0;
 
+	// false for lights without finite bounds, they are not in the light bvh
+	virtual bool Bounds(FLightBounds& outBounds) const { return false; }
+
 protected:
 	int lightFlags;
 	FPoint3	worldPosition;
@@ -91,6 +138,13 @@ public:
 
 	FColor Power() const override { return intensity * 4 * kPi; }
 
+	bool Bounds(FLightBounds& outBounds) const override
+	{
+		// all directions
+		outBounds = FLightBounds(FBounds3(worldPosition), FVector3(0, 0, 1), Power().Luminance(), -1, 0, false);
+		return true;
+	}
+
 	FLightSample Sample_Li(const FIntersection& isect, const FFloat2& random) const override
 	{
 		FLightSample sample;
@@ -187,6 +241,7 @@ public:
 		: FLight(eLightFlags::AreaLight, worldpos, samplesNum)
 		, radiance(radiance)
 		, shape(inShape)
+		, sampling(ShapeSamplingArea)
 	{
 		power = radiance * shape->Area() * kPi;
 	}
@@ -194,13 +249,25 @@ public:
 	bool IsDelta() const override { return false; }
 	bool IsFinite() const override { return true; }
 
+	// takes the scene's area light sampling
+	void Preprocess(const FScene& scene) override;
+
 	FColor Power() const override { return power; }
 
+	bool Bounds(FLightBounds& outBounds) const override
+	{
+		// diffuse emission from the front of the surface
+		FDirectionCone normals = shape->NormalBounds();
+		outBounds = FLightBounds(shape->WorldBounds(), normals.w, radiance.Luminance() * shape->Area(), normals.cosTheta, 0, false);
+		return true;
+	}
+
 	FLightSample Sample_Li(const FIntersection& isect, const FFloat2& random) const override
 	{
 		FLightSample sample;
-		FLightIntersection light_isect = shape->SampleDirection(isect, random, &sample.pdf);
+		FLightIntersection light_isect = shape->SampleDirection(isect, random, &sample.pdf, sampling);
 		sample.pos = light_isect.position;
+		sample.normal = light_isect.normal;
 
 		if (sample.pdf == 0 || (light_isect.position - isect.position).Length2() == 0)
 		{
@@ -217,7 +284,7 @@ public:
 
 	Float Pdf_Li(const FIntersection& isect, const FVector3& world_wi) const override
 	{
-		return shape->Pdf_Direction(isect, world_wi);
+		return shape->Pdf_Direction(isect, world_wi, sampling);
 	}
 
 	/*
@@ -241,6 +308,7 @@ protected:
 	FColor	radiance;
 	FColor	power;
 	const FShape *shape;
+	eShapeSampling sampling;
 };
 
 // constant_environment_light_t
@@ -310,5 +378,64 @@ protected:
 	FColor power;
 };
 
+// environment map light
+//   radiance from an equirectangular (latitude-longitude) image around the scene, usually HDR. the
+//   top row of the map is frame.n, the left column faces frame.s and phi turns towards frame.t.
+//   directions are sampled in proportion to the luminance of the pixels times sin(theta), the solid
+//   angle of a pixel, so a small bright sun is found by the light samples instead of by chance.
+// https://www.pbr-book.org/3ed-2018/Light_Sources/Infinite_Area_Lights
+class FEnvironmentMapLight : public FLight
+{
+public:
+	// the default frame has the map's top row along +y, the up of the scenes
+	FEnvironmentMapLight(const FPoint3& worldpos, int samplesNum, const std::string& filename, const FColor& scale = FColor(1, 1, 1),
+		const FFrame& frame = FFrame(FVector3(1, 0, 0), FVector3(0, 0, -1), FNormal3(0, 1, 0)));
+
+	bool IsDelta() const override { return false; }
+	bool IsFinite() const override { return false; }
+
+	void Preprocess(const FScene& scene) override;
+	FColor Power() const override { return power; }
+
+	FLightSample Sample_Li(const FIntersection& isect, const FFloat2& uv) const override;
+	Float Pdf_Li(const FIntersection& isect, const FVector3& world_wi) const override;
+
+	FColor Le(const FRay& ray) const override
+	{
+		return Lookup(DirectionToMap(Normalize(ray.Dir())));
+	}
+
+protected:
+	// (phi / 2pi, theta / pi) of a direction
+	FPoint2 DirectionToMap(const FVector3& world_w) const
+	{
+		FVector3 w = frame.ToLocal(world_w);
+		return FPoint2(SphericalPhi(w) * kInv2Pi, SphericalTheta(w) * kInvPi);
+	}
+
+	// the radiance is constant over a pixel, as the sampling density
+	FColor Lookup(const FPoint2& st) const
+	{
+		int x = Clamp((int)(st[0] * width), 0, width - 1);
+		int y = Clamp((int)(st[1] * height), 0, height - 1);
+		return pixels[y * width + x] * scale;
+	}
+
+protected:
+	int width;
+	int height;
+	std::vector<FColor> pixels;
+	FColor scale;
+	FFrame frame;
+
+	std::unique_ptr<FDistribution2D> distribution;
+
+	FPoint3	worldCenter;
+	Float worldRadius;
+	// radiance averaged over the sphere of directions
+	FColor average;
+	FColor power;
+};
+
 } // namespace pbrt
 
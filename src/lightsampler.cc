@@ -0,0 +1,303 @@
+// \brief
+//		lightsampler.cc
+//
+
+#include "lightsampler.h"
+#include "sampler.h"
+
+
+namespace pbrt
+{
+
+FPowerLightSampler::FPowerLightSampler(const std::vector<FLight*>& inLights)
+	: lights(inLights.begin(), inLights.end())
+{
+	std::vector<Float> weights(lights.size());
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		weights[i] = std::max(lights[i]->Power().Luminance(), (Float)0);
+		lightToIndex[lights[i]] = (int)i;
+	} // end for i
+
+	aliasTable = FAliasTable(weights);
+}
+
+// the power distribution does not depend on the receiving point
+FSampledLight FPowerLightSampler::Sample(const FIntersection&, Float u) const
+{
+	Float pmf;
+	int index = aliasTable.Sample(u, &pmf);
+	if (index < 0)
+		return FSampledLight();
+
+	return FSampledLight(lights[index], pmf);
+}
+
+Float FPowerLightSampler::PMF(const FIntersection&, const FLight* light) const
+{
+	auto iter = lightToIndex.find(light);
+	return iter != lightToIndex.end() ? aliasTable.PMF(iter->second) : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// bvh light sampler
+
+static Float SurfaceArea(const FBounds3& bounds)
+{
+	FVector3 d = bounds._max - bounds._min;
+	return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+}
+
+// cost of a node with bounds b inside a parent with extent bounds, split along dim: power times the
+// solid angle of the emission directions times the surface area, penalizing thin splits of a wide parent
+static Float EvaluateCost(const FLightBounds& b, const FBounds3& bounds, int dim)
+{
+	Float theta_o = std::acos(Clamp(b.cosTheta_o, (Float)-1, (Float)1));
+	Float theta_e = std::acos(Clamp(b.cosTheta_e, (Float)-1, (Float)1));
+	Float theta_w = std::min(theta_o + theta_e, kPi);
+	Float sinTheta_o = std::sqrt(std::max((Float)0, 1 - b.cosTheta_o * b.cosTheta_o));
+	Float M_omega = 2 * kPi * (1 - b.cosTheta_o) +
+		kPi / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sinTheta_o + b.cosTheta_o);
+
+	FVector3 d = bounds._max - bounds._min;
+	Float Kr = std::max(d.x, std::max(d.y, d.z)) / std::max(d[dim], (Float)1e-6);
+	return b.phi * M_omega * Kr * SurfaceArea(b.bounds);
+}
+
+FBVHLightSampler::FBVHLightSampler(const std::vector<FLight*>& inLights)
+	: lights(inLights.begin(), inLights.end())
+	, pInfinite(0)
+{
+	std::vector<std::pair<int, FLightBounds>> bvhLights;
+	std::vector<Float> infinitePowers;
+	Float bvhPower = 0;
+
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		// lights that emit nothing are never picked
+		const Float power = std::max(lights[i]->Power().Luminance(), (Float)0);
+
+		FLightBounds lightBounds;
+		if (!lights[i]->Bounds(lightBounds))
+		{
+			if (power > 0)
+			{
+				infiniteLights.push_back(lights[i]);
+				infinitePowers.push_back(power);
+			}
+		}
+		else if (lightBounds.phi > 0)
+		{
+			bvhLights.push_back(std::make_pair((int)i, lightBounds));
+			bvhPower += power;
+		}
+	} // end for i
+
+	if (!infiniteLights.empty())
+	{
+		Float infinitePower = 0;
+		for (Float power : infinitePowers)
+		{
+			infinitePower += power;
+		}
+
+		infiniteAliasTable = FAliasTable(infinitePowers);
+		pInfinite = bvhLights.empty() ? 1 : infinitePower / (infinitePower + bvhPower);
+	}
+
+	if (!bvhLights.empty())
+	{
+		nodes.reserve(2 * bvhLights.size() - 1);
+		Build(bvhLights, 0, (int)bvhLights.size(), 0, 0);
+	}
+}
+
+int FBVHLightSampler::Build(std::vector<std::pair<int, FLightBounds>>& bvhLights, int start, int end, uint64_t bitTrail, int depth)
+{
+	PBRT_DOCHECK(start < end);
+
+	if (end - start == 1)
+	{
+		const int nodeIndex = (int)nodes.size();
+		nodes.push_back(FNode{ bvhLights[start].second, bvhLights[start].first, true });
+		lightToBitTrail[lights[bvhLights[start].first]] = bitTrail;
+		return nodeIndex;
+	}
+
+	FBounds3 bounds, centroidBounds;
+	for (int i = start; i < end; ++i)
+	{
+		bounds.Expand(bvhLights[i].second.bounds);
+		centroidBounds.Expand(bvhLights[i].second.Centroid());
+	}
+
+	// the bucket split of the lowest cost over the three axes
+	const int BUCKETS_NUM = 12;
+	Float minCost = kInfinity;
+	int minBucket = -1, minDim = -1;
+
+	auto BucketIndex = [&](const FLightBounds& lightBounds, int dim)
+	{
+		Float extent = centroidBounds._max[dim] - centroidBounds._min[dim];
+		int b = (int)(BUCKETS_NUM * (lightBounds.Centroid()[dim] - centroidBounds._min[dim]) / extent);
+		return Clamp(b, 0, BUCKETS_NUM - 1);
+	};
+
+	for (int dim = 0; dim < 3; ++dim)
+	{
+		if (centroidBounds._max[dim] == centroidBounds._min[dim])
+			continue;
+
+		FLightBounds buckets[BUCKETS_NUM];
+		for (int i = start; i < end; ++i)
+		{
+			int b = BucketIndex(bvhLights[i].second, dim);
+			buckets[b] = Union(buckets[b], bvhLights[i].second);
+		}
+
+		for (int split = 0; split < BUCKETS_NUM - 1; ++split)
+		{
+			FLightBounds below, above;
+			for (int b = 0; b <= split; ++b)
+				below = Union(below, buckets[b]);
+			for (int b = split + 1; b < BUCKETS_NUM; ++b)
+				above = Union(above, buckets[b]);
+
+			Float cost = EvaluateCost(below, bounds, dim) + EvaluateCost(above, bounds, dim);
+			if (cost > 0 && cost < minCost)
+			{
+				minCost = cost;
+				minBucket = split;
+				minDim = dim;
+			}
+		} // end for split
+	} // end for dim
+
+	int mid;
+	if (minDim == -1)
+	{
+		mid = (start + end) / 2;
+	}
+	else
+	{
+		auto iter = std::partition(bvhLights.begin() + start, bvhLights.begin() + end,
+			[&](const std::pair<int, FLightBounds>& light) { return BucketIndex(light.second, minDim) <= minBucket; });
+		mid = (int)(iter - bvhLights.begin());
+		if (mid == start || mid == end)
+		{
+			mid = (start + end) / 2;
+		}
+	}
+
+	// the bit trail has room for 64 levels
+	PBRT_DOCHECK(depth < 64);
+
+	const int nodeIndex = (int)nodes.size();
+	nodes.push_back(FNode());
+
+	const int child0 = Build(bvhLights, start, mid, bitTrail, depth + 1);
+	const int child1 = Build(bvhLights, mid, end, bitTrail | (1ull << depth), depth + 1);
+	PBRT_DOCHECK(child0 == nodeIndex + 1);
+
+	nodes[nodeIndex] = FNode{ Union(nodes[child0].bounds, nodes[child1].bounds), child1, false };
+	return nodeIndex;
+}
+
+Float FBVHLightSampler::ChildPMF(const FNode& node, int nodeIndex, const FPoint3& p, const FNormal3& n) const
+{
+	Float c0 = nodes[nodeIndex + 1].bounds.Importance(p, n);
+	Float c1 = nodes[node.childOrLightIndex].bounds.Importance(p, n);
+	if (c0 == 0 && c1 == 0)
+		return -1;
+
+	return c0 / (c0 + c1);
+}
+
+FSampledLight FBVHLightSampler::Sample(const FIntersection& isect, Float u) const
+{
+	if (u < pInfinite)
+	{
+		Float pmf;
+		int index = infiniteAliasTable.Sample(std::min(u / pInfinite, FRNG::OneMinusEpsilon), &pmf);
+		return FSampledLight(infiniteLights[index], pInfinite * pmf);
+	}
+
+	if (nodes.empty())
+		return FSampledLight();
+
+	// reuse u at every level
+	u = std::min((u - pInfinite) / (1 - pInfinite), FRNG::OneMinusEpsilon);
+
+	const FPoint3& p = isect.position;
+	const FNormal3& n = isect.normal;
+	int nodeIndex = 0;
+	Float pmf = 1 - pInfinite;
+
+	while (!nodes[nodeIndex].bLeaf)
+	{
+		const FNode& node = nodes[nodeIndex];
+		Float p0 = ChildPMF(node, nodeIndex, p, n);
+		if (p0 < 0)
+			return FSampledLight();
+
+		if (u < p0)
+		{
+			u = std::min(u / p0, FRNG::OneMinusEpsilon);
+			pmf *= p0;
+			nodeIndex = nodeIndex + 1;
+		}
+		else
+		{
+			u = std::min((u - p0) / (1 - p0), FRNG::OneMinusEpsilon);
+			pmf *= 1 - p0;
+			nodeIndex = node.childOrLightIndex;
+		}
+	} // end while
+
+	// a single light at the root is taken without looking at its importance
+	const FNode& leaf = nodes[nodeIndex];
+	if (nodeIndex > 0 || leaf.bounds.Importance(p, n) > 0)
+		return FSampledLight(lights[leaf.childOrLightIndex], pmf);
+
+	return FSampledLight();
+}
+
+Float FBVHLightSampler::PMF(const FIntersection& isect, const FLight* light) const
+{
+	auto iter = lightToBitTrail.find(light);
+	if (iter == lightToBitTrail.end())
+	{
+		auto infinite = std::find(infiniteLights.begin(), infiniteLights.end(), light);
+		return infinite != infiniteLights.end() ? pInfinite * infiniteAliasTable.PMF((int)(infinite - infiniteLights.begin())) : 0;
+	}
+
+	// follow the bit trail down to the light
+	uint64_t bitTrail = iter->second;
+	int nodeIndex = 0;
+	Float pmf = 1 - pInfinite;
+
+	while (!nodes[nodeIndex].bLeaf)
+	{
+		const FNode& node = nodes[nodeIndex];
+		Float p0 = ChildPMF(node, nodeIndex, isect.position, isect.normal);
+		if (p0 < 0)
+			return 0;
+
+		if (bitTrail & 1)
+		{
+			pmf *= 1 - p0;
+			nodeIndex = node.childOrLightIndex;
+		}
+		else
+		{
+			pmf *= p0;
+			nodeIndex = nodeIndex + 1;
+		}
+
+		bitTrail >>= 1;
+	} // end while
+
+	return pmf;
+}
+
+} // namespace pbrt
@@ -0,0 +1,106 @@
+// \brief
+//		light samplers: pick the light that is sampled at a shading point
+//
+
+#pragma once
+
+#include "pbrt.h"
+#include "light.h"
+#include "sampling.h"
+
+#include <unordered_map>
+
+
+namespace pbrt
+{
+
+enum eLightSampling
+{
+	LightSamplingPower = 0,
+	LightSamplingBVH,
+};
+
+struct FSampledLight
+{
+	const FLight* light;
+	Float pmf;
+
+	FSampledLight() : light(nullptr), pmf(0) {}
+	FSampledLight(const FLight* light, Float pmf) : light(light), pmf(pmf) {}
+};
+
+// light sampler
+//   integrators sample one light per estimate and divide by its pmf, so the cost of a shading point
+//   does not grow with the number of lights. the pmf may depend on the shading point.
+class FLightSampler
+{
+public:
+	virtual ~FLightSampler() {}
+
+	// light is nullptr if there is none
+	virtual FSampledLight Sample(const FIntersection& isect, Float u) const = 0;
+	// probability that Sample at isect returns light
+	virtual Float PMF(const FIntersection& isect, const FLight* light) const = 0;
+};
+
+// power light sampler
+//   probability proportional to the emitted power of the light, from an alias table
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/lightsamplers.h (PowerLightSampler)
+class FPowerLightSampler : public FLightSampler
+{
+public:
+	// the lights must be preprocessed, the power of infinite lights depends on the scene bounds
+	FPowerLightSampler(const std::vector<FLight*>& inLights);
+
+	FSampledLight Sample(const FIntersection& isect, Float u) const override;
+	Float PMF(const FIntersection& isect, const FLight* light) const override;
+
+protected:
+	std::vector<const FLight*> lights;
+	std::unordered_map<const FLight*, int> lightToIndex;
+	FAliasTable aliasTable;
+};
+
+// bvh light sampler
+//   a bvh over the light bounds of the finite lights. sampling walks down from the root and picks a
+//   child with probability proportional to the importance of its bounds at the shading point, so
+//   near lights facing the point are chosen far more often than their power alone would give. the
+//   infinite lights are picked by power, together taking their share of the total power.
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/lightsamplers.h (BVHLightSampler)
+class FBVHLightSampler : public FLightSampler
+{
+public:
+	// the lights must be preprocessed
+	FBVHLightSampler(const std::vector<FLight*>& inLights);
+
+	FSampledLight Sample(const FIntersection& isect, Float u) const override;
+	Float PMF(const FIntersection& isect, const FLight* light) const override;
+
+	int NodesNum() const { return (int)nodes.size(); }
+
+protected:
+	// the second child of an interior node is at childOrLightIndex, the first right after it
+	struct FNode
+	{
+		FLightBounds bounds;
+		int childOrLightIndex;
+		bool bLeaf;
+	};
+
+	// builds the subtree of bvhLights[start, end) and returns its node index. bitTrail is the path
+	// from the root, one bit per level (1 for the second child)
+	int Build(std::vector<std::pair<int, FLightBounds>>& bvhLights, int start, int end, uint64_t bitTrail, int depth);
+
+	// probability of picking the first child of an interior node at p, -1 if neither child contributes
+	Float ChildPMF(const FNode& node, int nodeIndex, const FPoint3& p, const FNormal3& n) const;
+
+protected:
+	std::vector<const FLight*> lights;
+	std::vector<const FLight*> infiniteLights;
+	FAliasTable infiniteAliasTable;
+	Float pInfinite;
+	std::vector<FNode> nodes;
+	std::unordered_map<const FLight*, uint64_t> lightToBitTrail;
+};
+
+} // namespace pbrt
@@ -5,6 +5,7 @@
 #include "pbrt.h"
 #include "light.h"
 #include "integrator.h"
+#include "restir.h"
 
 
 using namespace pbrt;
@@ -24,38 +25,38 @@ std::shared_ptr<FScene> create_cornellbox_scene(const FVector2& filmsize)
 	const FColor backgroundclr(0.0f, 0.0f, 0.0f);
 	scene->CreateLight<FEnvironmentLight>(FPoint3(0, 0, 0), 1, backgroundclr);
 
-	std::shared_ptr<FMaterial> red = scene->CreateMaterial<FMatteMaterial>(FColor(0.63f, 0.065f, 0.05f));
-	std::shared_ptr<FMaterial> green = scene->CreateMaterial<FMatteMaterial>(FColor(0.14f, 0.45f, 0.091f));
-	std::shared_ptr<FMaterial> white = scene->CreateMaterial<FMatteMaterial>(FColor(0.725f, 0.71f, 0.68f));
-	std::shared_ptr<FMaterial> golden_mat = scene->CreateMaterial<FMetalMaterial>(FColor(0.18f, 0.15f, 0.81f), FColor(0.11f, 0.11f, 0.11f), 0.2f, 0.2f, false);
+	FMaterialHandle red = scene->CreateMaterial<FMatteMaterial>(FColor(0.63f, 0.065f, 0.05f));
+	FMaterialHandle green = scene->CreateMaterial<FMatteMaterial>(FColor(0.14f, 0.45f, 0.091f));
+	FMaterialHandle white = scene->CreateMaterial<FMatteMaterial>(FColor(0.725f, 0.71f, 0.68f));
+	FMaterialHandle golden_mat = scene->CreateMaterial<FMetalMaterial>(FColor(0.18f, 0.15f, 0.81f), FColor(0.11f, 0.11f, 0.11f), 0.2f, 0.2f, false);
 
 	// light
-	std::shared_ptr<FMaterial> mat_light0 = scene->CreateMaterial<FMatteMaterial>(FColor(0.65f, 0.65f, 0.65f));
-	std::vector<std::shared_ptr<FShape>> shape_light0 = scene->CreateTriangleMesh("scene\\cornellbox\\light.obj", true, true);
+	FMaterialHandle mat_light0 = scene->CreateMaterial<FMatteMaterial>(FColor(0.65f, 0.65f, 0.65f));
+	std::vector<FShapeHandle> shape_light0 = scene->CreateTriangles("scene\\cornellbox\\light.obj", true, true);
 	const FColor radiance(8.0f * FVector3(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * FVector3(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * FVector3(0.737f + 0.642f, 0.737f + 0.159f, 0.737f));
 	scene->CreateAreaLights(1, radiance, shape_light0, mat_light0);
 	
 	//scene->CreateLight<FPointLight>(FVector3(278, 273, 0), 1, FColor(0.63f, 0.065f, 0.05f));
 
 	// wall
-	std::vector<std::shared_ptr<FShape>> floor = scene->CreateTriangleMesh("scene\\cornellbox\\floor.obj", true, true);
-	scene->CreatePrimitives(floor, white);
+	FShapeHandle floor = scene->CreateTriangleMesh("scene\\cornellbox\\floor.obj", true, true);
+	scene->CreatePrimitive(floor, white);
 
-	std::vector<std::shared_ptr<FShape>> shortbox = scene->CreateTriangleMesh("scene\\cornellbox\\shortbox.obj", true, true);
-	scene->CreatePrimitives(shortbox, white);
+	FShapeHandle shortbox = scene->CreateTriangleMesh("scene\\cornellbox\\shortbox.obj", true, true);
+	scene->CreatePrimitive(shortbox, white);
 
-	std::vector<std::shared_ptr<FShape>> tallbox = scene->CreateTriangleMesh("scene\\cornellbox\\tallbox.obj", true, true);
-	scene->CreatePrimitives(tallbox, golden_mat);
+	FShapeHandle tallbox = scene->CreateTriangleMesh("scene\\cornellbox\\tallbox.obj", true, true);
+	scene->CreatePrimitive(tallbox, golden_mat);
 
-	std::vector<std::shared_ptr<FShape>> left = scene->CreateTriangleMesh("scene\\cornellbox\\left.obj", true, true);
-	scene->CreatePrimitives(left, red);
+	FShapeHandle left = scene->CreateTriangleMesh("scene\\cornellbox\\left.obj", true, true);
+	scene->CreatePrimitive(left, red);
 
-	std::vector<std::shared_ptr<FShape>> right = scene->CreateTriangleMesh("scene\\cornellbox\\right.obj", true, true);
-	scene->CreatePrimitives(right, green);
+	FShapeHandle right = scene->CreateTriangleMesh("scene\\cornellbox\\right.obj", true, true);
+	scene->CreatePrimitive(right, green);
 
-	std::shared_ptr<FMaterial> glass_mat = scene->CreateMaterial<FGlassMaterial>(1.5f, FColor(0.98f), FColor(0.98f));
-	std::shared_ptr<FShape> bunny_04 = scene->CreateShape<FSphere>(FVector3(273, 273, 150), 60.f);
-	// scene->CreatePrimitive(bunny_04.get(), glass_mat.get(), nullptr);
+	// FMaterialHandle glass_mat = scene->CreateMaterial<FGlassMaterial>(1.5f, FColor(0.98f), FColor(0.98f));
+	// FShapeHandle bunny_04 = scene->CreateShape<FSphere>(FVector3(273, 273, 150), 60.f);
+	// scene->CreatePrimitive(bunny_04, glass_mat);
 
 	scene->Preprocess();
 	return scene;
@@ -69,47 +70,67 @@ std::shared_ptr<FScene> create_bunny_scene(const FVector2& filmsize)
 	const Float vfov = 60.0;
 
 	std::shared_ptr<FScene> scene = std::make_shared<FScene>("bunny_scene");
+	scene->SetMeshCleanup(true);
 
 	scene->CreateCamera<FCamera>(lookfrom, Normalize(lookat - lookfrom), vup, vfov, filmsize);
 
 	const FColor backgroundclr(0.1f, 0.1f, 0.5f);
 	scene->CreateLight<FEnvironmentLight>(FPoint3(0, 0, 0), 1, backgroundclr);
+	// or an hdr sky, importance sampled by the brightness of its pixels
+	// scene->CreateLight<FEnvironmentMapLight>(FPoint3(0, 0, 0), 1, "scene\\envmap\\sky.hdr");
 
-	std::shared_ptr<FMaterial> red = scene->CreateMaterial<FMatteMaterial>(FColor(0.63f, 0.065f, 0.05f));
-	std::shared_ptr<FMaterial> green = scene->CreateMaterial<FMatteMaterial>(FColor(0.14f, 0.45f, 0.091f));
-	std::shared_ptr<FMaterial> white = scene->CreateMaterial<FMatteMaterial>(FColor(0.725f, 0.71f, 0.68f));
+	FMaterialHandle red = scene->CreateMaterial<FMatteMaterial>(FColor(0.63f, 0.065f, 0.05f));
+	FMaterialHandle green = scene->CreateMaterial<FMatteMaterial>(FColor(0.14f, 0.45f, 0.091f));
 	
 	// scene->CreateLight<FPointLight>(FVector3(-200, 400, -200), 1, FColor(630000.f, 650000.f, 650000.f));
 	// light
-	std::shared_ptr<FMaterial> mat_light0 = scene->CreateMaterial<FMatteMaterial>(FColor(0.65f, 0.65f, 0.65f));
-	std::shared_ptr<FShape> shape_light0 = scene->CreateShape<FRectangle>(FRectangle::FromXZ(-100, 100, -100, 100, 350, true));
+	FMaterialHandle mat_light0 = scene->CreateMaterial<FMatteMaterial>(FColor(0.65f, 0.65f, 0.65f));
+	FShapeHandle shape_light0 = scene->CreateShape<FRectangle>(FRectangle::FromXZ(-100, 100, -100, 100, 350, true));
 	const FColor radiance(8.0f * FVector3(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * FVector3(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * FVector3(0.737f + 0.642f, 0.737f + 0.159f, 0.737f));
 	scene->CreateAreaLight(1, radiance, shape_light0, mat_light0);
 
 	// floor
-	std::shared_ptr<FShape> floor = scene->CreateShape<FRectangle>(FRectangle::FromXZ(-200, 200, -200, 200, 0));
-	scene->CreatePrimitive(floor.get(), green.get(), nullptr);
+	FShapeHandle floor = scene->CreateShape<FRectangle>(FRectangle::FromXZ(-200, 200, -200, 200, 0));
+	scene->CreatePrimitive(floor, green);
 
-	// bunny
-	std::vector<std::shared_ptr<FShape>> bunny_01 = scene->CreateTriangleMesh("scene\\bunny\\bunny.obj", true, true, FVector3(0,0,0), 500.f);
-	scene->CreatePrimitives(bunny_01, red);
+	// bunny, the first two meshes are loaded and their bvhs built concurrently before rendering.
+	// the other two are loaded when a ray first enters their box, and evicted again when the
+	// four do not fit the budget
+	scene->SetGeometryMemoryBudget(32 * 1024 * 1024);
+	FTaskGraph loader;
 
-	std::shared_ptr<FMaterial> plastic_white = scene->CreateMaterial<FPlasticMaterial>(FColor(0.35f, 0.12f, 0.48f), FColor(1) - FColor(0.35f, 0.12f, 0.48f), 0.1f, false);
-	std::vector<std::shared_ptr<FShape>> bunny_02 = scene->CreateTriangleMesh("scene\\bunny\\bunny.obj", true, true, FVector3(-100, 0, -100), 500.f);
-	scene->CreatePrimitives(bunny_02, plastic_white);
+	FShapeHandle bunny_01 = scene->LoadTriangleMeshProxy(loader, "scene\\bunny\\bunny.obj", true, true, FVector3(0,0,0), 500.f);
+	scene->CreatePrimitive(bunny_01, red);
 
-	std::shared_ptr<FMaterial> golden_mat = scene->CreateMaterial<FMetalMaterial>(FColor(0.18f, 0.15f, 0.81f), FColor(0.11f, 0.11f, 0.11f), 0.2f, 0.2f, false);
-	std::vector<std::shared_ptr<FShape>> bunny_03 = scene->CreateTriangleMesh("scene\\bunny\\bunny.obj", true, true, FVector3(0, 0, -100), 500.f);
-	scene->CreatePrimitives(bunny_03, golden_mat);
+	FMaterialHandle plastic_white = scene->CreateMaterial<FPlasticMaterial>(FColor(0.35f, 0.12f, 0.48f), FColor(1) - FColor(0.35f, 0.12f, 0.48f), 0.1f, false);
+	FShapeHandle bunny_02 = scene->LoadTriangleMeshProxy(loader, "scene\\bunny\\bunny.obj", true, true, FVector3(-100, 0, -100), 500.f);
+	scene->CreatePrimitive(bunny_02, plastic_white);
 
-	std::shared_ptr<FMaterial> glass_mat = scene->CreateMaterial<FGlassMaterial>(1.5f, FColor(0.98f), FColor(0.98f));
-	std::vector<std::shared_ptr<FShape>> bunny_04 = scene->CreateTriangleMesh("scene\\bunny\\bunny.obj", true, true, FVector3(-100, 0, 0), 500.f);
-	scene->CreatePrimitives(bunny_04, glass_mat);
+	FMaterialHandle golden_mat = scene->CreateMaterial<FMetalMaterial>(FColor(0.18f, 0.15f, 0.81f), FColor(0.11f, 0.11f, 0.11f), 0.2f, 0.2f, false);
+	FShapeHandle bunny_03 = scene->CreateTriangleMeshProxy("scene\\bunny\\bunny.obj", true, true, FVector3(0, 0, -100), 500.f);
+	scene->CreatePrimitive(bunny_03, golden_mat);
 
+	FMaterialHandle glass_mat = scene->CreateMaterial<FGlassMaterial>(1.5f, FColor(0.98f), FColor(0.98f));
+	FShapeHandle bunny_04 = scene->CreateTriangleMeshProxy("scene\\bunny\\bunny.obj", true, true, FVector3(-100, 0, 0), 500.f);
+	scene->CreatePrimitive(bunny_04, glass_mat);
+
+	loader.Wait();
 	scene->Preprocess();
 	return scene;
 }
 
+std::shared_ptr<FSampler> create_sampler(const char* name, int samples_per_pixel)
+{
+	if (strcmp(name, "stratified") == 0)
+		return std::make_shared<FStratifiedSampler>(samples_per_pixel);
+	if (strcmp(name, "sobol") == 0)
+		return std::make_shared<FSobolSampler>(samples_per_pixel);
+	if (strcmp(name, "bluenoise") == 0)
+		return std::make_shared<FBlueNoiseSampler>(samples_per_pixel);
+
+	return std::make_shared<FRandomSampler>(samples_per_pixel);
+}
+
 int main(int argc, char* argv[])
 {
 	const int width = 1024, height = 1024;
@@ -118,12 +139,20 @@ int main(int argc, char* argv[])
 	std::shared_ptr<FScene> scene = nullptr;
 	int samples_per_pixel = 50;
 
-	PBRT_PRINT("pbrt.exe  sceneid   spp\n");
+	PBRT_PRINT("pbrt.exe  sceneid   spp   [threads]   [random|stratified|sobol|bluenoise]\n");
 	if (argc < 2)
 	{
 		return 0;
 	}
 
+	// 0 or none, one per hardware thread
+	if (argc > 3)
+	{
+		SetParallelThreadsNum(atoi(argv[3]));
+	}
+	// on numa machines, pin the workers and replicate the bvh with FScene::SetBVHReplication
+	// SetParallelAffinity(true);
+
 	int sceneId = atoi(argv[1]);
 	switch (sceneId)
 	{
@@ -146,14 +175,17 @@ int main(int argc, char* argv[])
 		}
 	}
 	
-	std::shared_ptr<FSampler> sampler = std::make_shared<FRandomSampler>(samples_per_pixel);
+	std::shared_ptr<FSampler> sampler = create_sampler(argc > 4 ? argv[4] : "random", samples_per_pixel);
 
 	//FDebugIntegrator integrator;
 	//FWhittedIntegrator integrator(5);
 	//FPathIntegratorRecursive integrator(5);
 	FPathIntegratorIteration integrator(5);
+	// direct lighting with reused light samples, one pass per sample
+	//FReSTIRIntegrator integrator(5);
 
-	integrator.Render(scene.get(), sampler.get(), &film, 16);
+	integrator.Render(scene.get(), sampler.get(), &film);
+	scene->GeometryCache()->PrintStats();
 
 	char fullname[256];
 	sprintf(fullname, "%s_%d", scene->NameStr(), samples_per_pixel);
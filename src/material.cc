@@ -9,26 +9,26 @@
 namespace pbrt
 {
 
-std::unique_ptr<FBSDF> FPlasticMaterial::Scattering(const FIntersection& isect, FSampler* sampler) const
+FBSDF* FPlasticMaterial::Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const
 {
 	Float u = sampler->GetFloat();
 	if (u < Qd)
 	{
-		return std::make_unique<FLambertionReflection>(FFrame(isect.normal), Kd / Qd);
+		return arena.Alloc<FLambertionReflection>(FFrame(isect.shadingNormal), Kd / Qd);
 	}
 	else
 	{
-		Fresnel* fresnel = new FresnelDielectric(1.5f, 1.f);
+		Fresnel* fresnel = arena.Alloc<FresnelDielectric>(1.5f, 1.f);
 		// Create microfacet distribution _distrib_ for plastic material
 		Float rough = roughness;
 		if (remapRoughness)
 			rough = TrowbridgeReitzDistribution::RoughnessToAlpha(rough);
-		MicrofacetDistribution* distrib = new TrowbridgeReitzDistribution(rough, rough);
-		return std::make_unique<FMicrofacetReflection>(FFrame(isect.normal), Ks / (1 - Qd), distrib, fresnel);
+		MicrofacetDistribution* distrib = arena.Alloc<TrowbridgeReitzDistribution>(rough, rough);
+		return arena.Alloc<FMicrofacetReflection>(FFrame(isect.shadingNormal), Ks / (1 - Qd), distrib, fresnel);
 	}
 }
 
-std::unique_ptr<FBSDF> FMetalMaterial::Scattering(const FIntersection& isect, FSampler* sampler) const
+FBSDF* FMetalMaterial::Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const
 {
 	Float uRough = uRoughness;
 	Float vRough = vRoughness;
@@ -36,10 +36,10 @@ std::unique_ptr<FBSDF> FMetalMaterial::Scattering(const FIntersection& isect, FS
 		uRough = TrowbridgeReitzDistribution::RoughnessToAlpha(uRough);
 		vRough = TrowbridgeReitzDistribution::RoughnessToAlpha(vRough);
 	}
-	Fresnel* frMf = new FresnelConductor(1.f, eta, k);
-	MicrofacetDistribution* distrib = new TrowbridgeReitzDistribution(uRough, vRough);
+	Fresnel* frMf = arena.Alloc<FresnelConductor>(1.f, eta, k);
+	MicrofacetDistribution* distrib = arena.Alloc<TrowbridgeReitzDistribution>(uRough, vRough);
 	
-	return std::make_unique<FMicrofacetReflection>(FFrame(isect.normal), FColor(1), distrib, frMf);
+	return arena.Alloc<FMicrofacetReflection>(FFrame(isect.shadingNormal), FColor(1), distrib, frMf);
 }
 
 
@@ -9,6 +9,7 @@
 #include "shape.h"
 #include "bsdf.h"
 #include "sampler.h"
+#include "memory.h"
 
 
 namespace pbrt
@@ -20,7 +21,8 @@ class FMaterial
 public:
 	virtual ~FMaterial() {}
 
-	virtual std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const = 0;
+	// the bsdf and everything it points to is allocated in arena
+	virtual FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const = 0;
 };
 
 // matte material
@@ -31,9 +33,9 @@ public:
 		: diffuseColor(diffuseColor)
 	{}
 
-	std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const override
+	FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const override
 	{
-		return std::make_unique<FLambertionReflection>(FFrame(isect.normal), diffuseColor);
+		return arena.Alloc<FLambertionReflection>(FFrame(isect.shadingNormal), diffuseColor);
 	}
 
 protected:
@@ -49,9 +51,9 @@ public:
 		: specularColor(specularColor)
 	{}
 
-	std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const override
+	FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const override
 	{
-		return std::make_unique<FSpecularReflection>(FFrame(isect.normal), specularColor);
+		return arena.Alloc<FSpecularReflection>(FFrame(isect.shadingNormal), specularColor);
 	}
 
 protected:
@@ -69,9 +71,9 @@ public:
 		, Kt(transmission)
 	{}
 
-	std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const override
+	FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const override
 	{
-		return std::make_unique<FFresnelSpecular>(FFrame(isect.normal), (Float)1, eta, Kr, Kt);
+		return arena.Alloc<FFresnelSpecular>(FFrame(isect.shadingNormal), (Float)1, eta, Kr, Kt);
 	}
 
 protected:
@@ -98,7 +100,7 @@ public:
 		Qd = Ld / L;
 	}
 
-	std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const override;
+	FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const override;
 
 protected:
 	FColor Kd;
@@ -126,7 +128,7 @@ public:
 	{
 	}
 
-	std::unique_ptr<FBSDF> Scattering(const FIntersection& isect, FSampler* sampler) const override;
+	FBSDF* Scattering(const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const override;
 
 protected:
 	const FColor eta;
@@ -0,0 +1,100 @@
+// \brief
+//		memory.cc
+//
+
+#include "memory.h"
+
+
+namespace pbrt
+{
+
+static uint8_t* AllocAligned(size_t bytes, size_t alignment)
+{
+	return static_cast<uint8_t*>(::operator new(bytes, std::align_val_t(alignment)));
+}
+
+static void FreeAligned(uint8_t* block, size_t alignment)
+{
+	::operator delete(block, std::align_val_t(alignment));
+}
+
+FMemoryArena::~FMemoryArena()
+{
+	if (currentBlock)
+	{
+		FreeAligned(currentBlock, ALIGNMENT);
+	}
+
+	for (auto& block : usedBlocks)
+	{
+		FreeAligned(block.second, ALIGNMENT);
+	}
+
+	for (auto& block : availableBlocks)
+	{
+		FreeAligned(block.second, ALIGNMENT);
+	}
+}
+
+void* FMemoryArena::Alloc(size_t bytes)
+{
+	bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	if (currentBlockPos + bytes > currentBlockSize)
+	{
+		// retire the current block and find or allocate a big enough one
+		if (currentBlock)
+		{
+			usedBlocks.push_back(std::make_pair(currentBlockSize, currentBlock));
+			currentBlock = nullptr;
+			currentBlockSize = 0;
+		}
+
+		for (auto iter = availableBlocks.begin(); iter != availableBlocks.end(); ++iter)
+		{
+			if (iter->first >= bytes)
+			{
+				currentBlockSize = iter->first;
+				currentBlock = iter->second;
+				availableBlocks.erase(iter);
+				break;
+			}
+		} // end for iter
+
+		if (!currentBlock)
+		{
+			currentBlockSize = std::max(bytes, blockSize);
+			currentBlock = AllocAligned(currentBlockSize, ALIGNMENT);
+		}
+
+		currentBlockPos = 0;
+	}
+
+	void* ptr = currentBlock + currentBlockPos;
+	currentBlockPos += bytes;
+	return ptr;
+}
+
+void FMemoryArena::Reset()
+{
+	currentBlockPos = 0;
+	availableBlocks.splice(availableBlocks.begin(), usedBlocks);
+}
+
+size_t FMemoryArena::TotalAllocated() const
+{
+	size_t total = currentBlockSize;
+	for (const auto& block : usedBlocks)
+	{
+		total += block.first;
+	}
+
+	for (const auto& block : availableBlocks)
+	{
+		total += block.first;
+	}
+
+	return total;
+}
+
+} // namespace pbrt
@@ -0,0 +1,65 @@
+// \brief
+//		memory arena: bump allocation for short lived per-thread objects
+//
+
+#pragma once
+
+#include "pbrt.h"
+
+#include <list>
+#include <new>
+#include <utility>
+
+
+namespace pbrt
+{
+
+// https://github.com/mmp/pbrt-v3/blob/master/src/core/memory.h
+//
+// memory arena
+//   allocates by bumping a pointer in big blocks, frees everything at once with Reset.
+//   destructors of the objects are never called, so only put objects in here that own no
+//   resources (eg. BSDFs, fresnels, microfacet distributions). not thread safe, one per thread.
+class FMemoryArena
+{
+public:
+	FMemoryArena(size_t inBlockSize = 64 * 1024)
+		: blockSize(inBlockSize)
+		, currentBlock(nullptr)
+		, currentBlockPos(0)
+		, currentBlockSize(0)
+	{}
+
+	~FMemoryArena();
+
+	FMemoryArena(const FMemoryArena&) = delete;
+	FMemoryArena& operator=(const FMemoryArena&) = delete;
+
+	void* Alloc(size_t bytes);
+
+	template<typename T, typename ...U>
+	T* Alloc(U&& ... args)
+	{
+		return new (Alloc(sizeof(T))) T(std::forward<U>(args)...);
+	}
+
+	// the memory is kept for the next allocations
+	void Reset();
+
+	size_t TotalAllocated() const;
+
+protected:
+	static const size_t ALIGNMENT = 16;
+
+	const size_t blockSize;
+
+	uint8_t* currentBlock;
+	size_t currentBlockPos;
+	size_t currentBlockSize;
+
+	// (size, block)
+	std::list<std::pair<size_t, uint8_t*>> usedBlocks;
+	std::list<std::pair<size_t, uint8_t*>> availableBlocks;
+};
+
+} // namespace pbrt
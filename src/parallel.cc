@@ -4,85 +4,446 @@
 
 #include "parallel.h"
 
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <fstream>
+#endif
+
 
 namespace pbrt
 {
-	static void thread_callback(FParallelSystem *inSystem)
+	// the system and queue index of the calling worker thread
+	static thread_local FParallelSystem* tls_system = nullptr;
+	static thread_local int tls_worker = -1;
+	static thread_local uint32_t tls_random = 1;
+	static thread_local int tls_numa_node = 0;
+
+	// steal rounds before an idle worker parks
+	static const int STEAL_ROUNDS = 4;
+
+	//////////////////////////////////////////////////////////////////////////
+	// numa topology
+
+	// logical cpus of every numa node, a single node with every cpu if unknown
+	struct FNumaTopology
 	{
-		while (1)
+		std::vector<std::vector<int>> nodes;
+
+		FNumaTopology()
 		{
-			FTask* task = inSystem->WaitForTask();
-			if (!task) {
-				break;
+#if defined(_WIN32)
+			ULONG highest = 0;
+			if (GetNumaHighestNodeNumber(&highest))
+			{
+				for (USHORT node = 0; node <= highest; ++node)
+				{
+					GROUP_AFFINITY affinity = {};
+					if (!GetNumaNodeProcessorMaskEx(node, &affinity) || affinity.Mask == 0)
+						continue;
+
+					std::vector<int> cpus;
+					for (int bit = 0; bit < 64; ++bit)
+					{
+						if (affinity.Mask & ((KAFFINITY)1 << bit))
+						{
+							cpus.push_back(affinity.Group * 64 + bit);
+						}
+					}
+					nodes.push_back(cpus);
+				} // end for node
 			}
+#elif defined(__linux__)
+			for (int node = 0; node < 256; ++node)
+			{
+				// eg. "0-7,16-23"
+				std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+				if (!file)
+					continue;
 
-			task->Execute();
-		} // end while
+				std::vector<int> cpus;
+				std::string range;
+				while (std::getline(file, range, ','))
+				{
+					int first = 0, last = 0;
+					int count = sscanf(range.c_str(), "%d-%d", &first, &last);
+					if (count == 1) { last = first; }
+					for (int cpu = first; count > 0 && cpu <= last; ++cpu)
+					{
+						cpus.push_back(cpu);
+					}
+				}
+
+				if (!cpus.empty())
+				{
+					nodes.push_back(cpus);
+				}
+			} // end for node
+#endif
+
+			if (nodes.empty())
+			{
+				nodes.push_back({});
+				for (int cpu = 0; cpu < (int)std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+				{
+					nodes[0].push_back(cpu);
+				}
+			}
+		}
+	};
+
+	static const FNumaTopology& NumaTopology()
+	{
+		static FNumaTopology topology;
+		return topology;
+	}
+
+	static bool PinCurrentThread(const std::vector<int>& cpus)
+	{
+		if (cpus.empty())
+			return false;
+
+#if defined(_WIN32)
+		// one processor group only
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = (WORD)(cpus[0] / 64);
+		for (int cpu : cpus)
+		{
+			if (cpu / 64 == affinity.Group)
+			{
+				affinity.Mask |= (KAFFINITY)1 << (cpu % 64);
+			}
+		}
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : cpus)
+		{
+			CPU_SET(cpu, &set);
+		}
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	int NumaNodesNum()
+	{
+		return (int)NumaTopology().nodes.size();
 	}
 
+	int CurrentNumaNode()
+	{
+		return tls_numa_node;
+	}
+
+	void RunOnNumaNode(int node, const std::function<void()>& func)
+	{
+		std::thread thread([node, &func]()
+		{
+			const FNumaTopology& topology = NumaTopology();
+			if (node >= 0 && node < (int)topology.nodes.size() && PinCurrentThread(topology.nodes[node]))
+			{
+				tls_numa_node = node;
+			}
+
+			func();
+		});
+
+		thread.join();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// parallel system
+
 
 	FParallelSystem::FParallelSystem()
-		: _bTerminateFlag(false)
+		: _queued(0)
+		, _unfinished(0)
+		, _sleepers(0)
+		, _readyWorkers(0)
+		, _bPinThreads(false)
+		, _bTerminateFlag(false)
 	{
 
 	}
 
-	void FParallelSystem::AddTask(FTask* inTask)
+	FParallelSystem::~FParallelSystem()
+	{
+		if (!_threads.empty())
+		{
+			Terminate();
+		}
+	}
+
+	void FParallelSystem::AddTask(FTask* inTask, FTaskGroup* inGroup)
 	{
-		std::unique_lock<std::mutex> lock(_mutex);
+		_unfinished.fetch_add(1);
+
+		inTask->group = inGroup;
+		if (inGroup)
+		{
+			inGroup->pending.fetch_add(1);
+		}
+
+		FWorkQueue& queue = (tls_system == this) ? *_queues[tls_worker] : _injected;
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(inTask);
+		}
+
+		_queued.fetch_add(1);
 
-		_tasks.push_back(inTask);
-	
-		_cv.notify_all();
+		// wake one parked worker, the others keep sleeping
+		if (_sleepers.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+			_sleepCv.notify_one();
+		}
 	}
 
-	FTask* FParallelSystem::WaitForTask()
+	FTask* FParallelSystem::PopBack(FWorkQueue& queue)
 	{
-		std::unique_lock<std::mutex> lock(_mutex);
-		
-		while(_tasks.size() <= 0 && !_bTerminateFlag)
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			return nullptr;
+
+		FTask* task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return task;
+	}
+
+	FTask* FParallelSystem::PopFront(FWorkQueue& queue)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			return nullptr;
+
+		FTask* task = queue.tasks.front();
+		queue.tasks.pop_front();
+		return task;
+	}
+
+	FTask* FParallelSystem::PopGroupTask(FWorkQueue& queue, const FTaskGroup* group)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		// newest first, the group's tasks were pushed last
+		for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it)
+		{
+			FTask* task = *it;
+			if (task->group == group)
+			{
+				queue.tasks.erase(std::next(it).base());
+				return task;
+			}
+		} // end for it
+
+		return nullptr;
+	}
+
+	FTask* FParallelSystem::FindTask(int worker)
+	{
+		FTask* task = PopBack(*_queues[worker]);
+		if (!task)
 		{
-			_cv.wait(lock);
+			task = PopFront(_injected);
 		}
 
-		FTask* outTask = nullptr;
-		if (_tasks.size() > 0)
+		// steal from random victims
+		const int numqueues = (int)_queues.size();
+		for (int round = 0; !task && numqueues > 1 && round < STEAL_ROUNDS * numqueues; ++round)
+		{
+			if (_queued.load(std::memory_order_relaxed) <= 0)
+				break;
+
+			// xorshift32
+			tls_random ^= tls_random << 13; tls_random ^= tls_random >> 17; tls_random ^= tls_random << 5;
+			int victim = (int)(tls_random % (uint32_t)numqueues);
+			if (victim != worker)
+			{
+				task = PopFront(*_queues[victim]);
+			}
+		} // end for round
+
+		if (task)
 		{
-			outTask = _tasks[0];
-			_tasks.erase(_tasks.begin());
+			_queued.fetch_sub(1);
 		}
 
-		_cv.notify_all();
-		return outTask;
+		return task;
+	}
+
+	FTask* FParallelSystem::WaitForTask(int worker)
+	{
+		while (1)
+		{
+			FTask* task = FindTask(worker);
+			if (task)
+				return task;
+
+			std::unique_lock<std::mutex> lock(_sleepMutex);
+			_sleepers.fetch_add(1);
+			_sleepCv.wait(lock, [this]() { return _queued.load() > 0 || _bTerminateFlag.load(); });
+			_sleepers.fetch_sub(1);
+
+			if (_bTerminateFlag.load() && _queued.load() <= 0)
+				return nullptr;
+		} // end while
+	}
+
+	void FParallelSystem::RunTask(FTask* task)
+	{
+		// the task may delete itself in Execute
+		FTaskGroup* group = task->group;
+
+		task->Execute();
+
+		if (group)
+		{
+			// under the lock, a waiter may destroy the group as soon as it sees zero
+			std::lock_guard<std::mutex> lock(group->mutex);
+			if (group->pending.fetch_sub(1) == 1)
+			{
+				group->cv.notify_all();
+			}
+		}
+
+		if (_unfinished.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> lock(_doneMutex);
+			_doneCv.notify_all();
+		}
+	}
+
+	void FParallelSystem::RunWorker(int worker)
+	{
+		tls_system = this;
+		tls_worker = worker;
+		tls_random = (uint32_t)worker * 0x9E3779B9u + 0x7F4A7C15u;
+
+		if (_bPinThreads)
+		{
+			// worker i goes to node i % n, so any number of workers is spread evenly
+			const FNumaTopology& topology = NumaTopology();
+			const int numnodes = (int)topology.nodes.size();
+			const int node = worker % numnodes;
+			const std::vector<int>& cpus = topology.nodes[node];
+
+			if (PinCurrentThread({ cpus[(worker / numnodes) % cpus.size()] }))
+			{
+				tls_numa_node = node;
+			}
+		}
+
+		// first touch from the worker itself
+		_queues[worker] = std::make_unique<FWorkQueue>();
+		{
+			std::unique_lock<std::mutex> lock(_doneMutex);
+			_readyWorkers++;
+			_doneCv.notify_all();
+
+			// no stealing before every queue exists
+			_doneCv.wait(lock, [this]() { return _readyWorkers >= (int)_queues.size(); });
+		}
+
+		while (1)
+		{
+			FTask* task = WaitForTask(worker);
+			if (!task) {
+				break;
+			}
+
+			RunTask(task);
+		} // end while
+
+		tls_system = nullptr;
+		tls_worker = -1;
+		tls_numa_node = 0;
 	}
 
-	void FParallelSystem::Start(int numthreads)
+	void FParallelSystem::Start(int numthreads, bool bPinThreads)
 	{
 		_bTerminateFlag = false;
+		_bPinThreads = bPinThreads;
+		_readyWorkers = 0;
+
+		_queues.clear();
+		_queues.resize(numthreads);
+
 		for (int i=0; i<numthreads; ++i)
 		{
-			_threads.push_back(std::thread(&thread_callback, this));
-		} // end for 
+			_threads.push_back(std::thread(&FParallelSystem::RunWorker, this, i));
+		} // end for
+
+		// the workers allocate their own queues
+		std::unique_lock<std::mutex> lock(_doneMutex);
+		_doneCv.wait(lock, [this, numthreads]() { return _readyWorkers >= numthreads; });
 	}
 
 	void FParallelSystem::Terminate()
 	{
-		_bTerminateFlag = true;
-		_cv.notify_all();
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+			_bTerminateFlag = true;
+			_sleepCv.notify_all();
+		}
 
 		for (int i = 0; i < _threads.size(); ++i)
 		{
 			_threads[i].join();
-		} // end for 
+		} // end for
+
+		_threads.clear();
 	}
 
 	void FParallelSystem::WaitForEmpty()
 	{
-		std::unique_lock<std::mutex> lock(_mutex);
+		std::unique_lock<std::mutex> lock(_doneMutex);
+
+		_doneCv.wait(lock, [this]() { return _unfinished.load() <= 0; });
+	}
 
-		while (_tasks.size() > 0) {
-			_cv.wait(lock);
+	void FParallelSystem::Wait(FTaskGroup& group)
+	{
+		if (IsWorkerThread())
+		{
+			// help instead of blocking the worker, but only with the group's own tasks. an unrelated
+			// task (a render tile) could need a lock or once_flag the caller holds, or reset its context.
+			// tasks of the group taken by other workers are waited for
+			while (group.pending.load() > 0)
+			{
+				FTask* task = PopGroupTask(*_queues[tls_worker], &group);
+				if (task)
+				{
+					_queued.fetch_sub(1);
+					RunTask(task);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			} // end while
+
+			// the last finisher may still hold the lock
+			std::lock_guard<std::mutex> lock(group.mutex);
+			return;
 		}
+
+		std::unique_lock<std::mutex> lock(group.mutex);
+		group.cv.wait(lock, [&group]() { return group.pending.load() <= 0; });
+	}
+
+	bool FParallelSystem::IsWorkerThread() const
+	{
+		return tls_system == this;
+	}
+
+	int FParallelSystem::WorkerIndex() const
+	{
+		return tls_system == this ? tls_worker : -1;
 	}
 
 	void FParallelSystem::WaitForFinish()
@@ -91,4 +452,210 @@ namespace pbrt
 		Terminate();
 	}
 
+	//////////////////////////////////////////////////////////////////////////
+	// task graph
+
+	void FTaskGraph::FNode::Execute()
+	{
+		func();
+		graph->Finish(this);
+	}
+
+	FTaskGraph::FTaskGraph(FParallelSystem& inParallel)
+		: parallel(inParallel)
+		, bStarted(false)
+	{
+
+	}
+
+	FTaskGraph::FTaskGraph()
+		: FTaskGraph(GlobalParallelSystem())
+	{
+
+	}
+
+	FTaskGraph::~FTaskGraph()
+	{
+		Wait();
+	}
+
+	FTaskGraph::FNode* FTaskGraph::Add(std::function<void()> func, const std::vector<FNode*>& dependencies)
+	{
+		std::unique_ptr<FNode> node = std::make_unique<FNode>();
+		node->graph = this;
+		node->func = std::move(func);
+		node->bFinished = false;
+
+		// held until the node is released by Start, so it can not be queued while being wired
+		node->remaining = 1;
+		for (FNode* dependency : dependencies)
+		{
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (!dependency->bFinished)
+			{
+				dependency->dependents.push_back(node.get());
+				node->remaining.fetch_add(1);
+			}
+		} // end for
+
+		FNode* outNode = node.get();
+		bool bRelease = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			nodes.push_back(std::move(node));
+			bRelease = bStarted;
+		}
+
+		if (bRelease)
+		{
+			Release(outNode);
+		}
+
+		return outNode;
+	}
+
+	void FTaskGraph::Start()
+	{
+		std::vector<FNode*> pending;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (bStarted)
+				return;
+
+			bStarted = true;
+			for (auto& node : nodes)
+			{
+				pending.push_back(node.get());
+			}
+		}
+
+		for (FNode* node : pending)
+		{
+			Release(node);
+		}
+	}
+
+	void FTaskGraph::Wait()
+	{
+		Start();
+		parallel.Wait(group);
+	}
+
+	void FTaskGraph::Release(FNode* node)
+	{
+		if (node->remaining.fetch_sub(1) == 1)
+		{
+			parallel.AddTask(node, &group);
+		}
+	}
+
+	void FTaskGraph::Finish(FNode* node)
+	{
+		std::vector<FNode*> ready;
+		{
+			std::lock_guard<std::mutex> lock(node->mutex);
+			node->bFinished = true;
+			ready.swap(node->dependents);
+		}
+
+		// queued before this node leaves the group, so Wait can not return early
+		for (FNode* dependent : ready)
+		{
+			Release(dependent);
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// global parallel system
+
+	static int s_parallel_threads_num = 0;
+	static bool s_parallel_affinity = false;
+
+	void SetParallelThreadsNum(int numthreads)
+	{
+		s_parallel_threads_num = numthreads;
+	}
+
+	void SetParallelAffinity(bool bPinThreads)
+	{
+		s_parallel_affinity = bPinThreads;
+	}
+
+	int ParallelThreadsNum()
+	{
+		if (s_parallel_threads_num > 0)
+			return s_parallel_threads_num;
+
+		return std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	FParallelSystem& GlobalParallelSystem()
+	{
+		static FParallelSystem system;
+		static std::once_flag startOnce;
+
+		std::call_once(startOnce, []() {
+			system.Start(ParallelThreadsNum(), s_parallel_affinity);
+			PBRT_PRINT("parallel system: %d threads%s, %d numa nodes\n", system.NumThreads(), s_parallel_affinity ? " pinned" : "", NumaNodesNum());
+		});
+
+		return system;
+	}
+
+	int64_t ParallelGrainSize(int64_t count)
+	{
+		// about 8 chunks per thread
+		const int64_t chunks = 8 * (int64_t)GlobalParallelSystem().NumThreads();
+
+		return std::max(count / chunks, (int64_t)1);
+	}
+
+	void ParallelForRange(int64_t begin, int64_t end, int64_t chunk, const std::function<void(int64_t, int64_t)>& func)
+	{
+		if (end <= begin)
+			return;
+
+		if (chunk <= 0)
+		{
+			chunk = ParallelGrainSize(end - begin);
+		}
+
+		const int64_t numchunks = (end - begin + chunk - 1) / chunk;
+		if (numchunks == 1)
+		{
+			func(begin, end);
+			return;
+		}
+
+		// every worker task and the caller take the next chunk until none are left
+		std::atomic<int64_t> next(0);
+		auto work = [&]()
+		{
+			while (1)
+			{
+				int64_t c = next.fetch_add(1);
+				if (c >= numchunks)
+					break;
+
+				int64_t start = begin + c * chunk;
+				func(start, std::min(start + chunk, end));
+			} // end while
+		};
+
+		FParallelSystem& parallel = GlobalParallelSystem();
+		const int numtasks = (int)std::min(numchunks - 1, (int64_t)parallel.NumThreads());
+
+		FTaskGroup group;
+		std::vector<FFunctionTask> tasks;
+		tasks.reserve(numtasks);
+		for (int i = 0; i < numtasks; ++i)
+		{
+			tasks.emplace_back(work);
+			parallel.AddTask(&tasks.back(), &group);
+		} // end for
+
+		work();
+		parallel.Wait(group);
+	}
+
 } // namespace pbrt
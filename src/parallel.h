@@ -9,41 +9,278 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
 
 
 namespace pbrt
 {
 
+class FTaskGroup;
+
 // task
 class FTask
 {
 public:
+	FTask() : group(nullptr) {}
+	virtual ~FTask() {}
+
 	virtual void Execute() = 0;
+
+protected:
+	// set by FParallelSystem::AddTask
+	FTaskGroup* group;
+
+	friend class FParallelSystem;
+};
+
+// a task built from a callable
+class FFunctionTask : public FTask
+{
+public:
+	FFunctionTask(std::function<void()> inFunc)
+		: func(std::move(inFunc))
+	{}
+
+	virtual void Execute() override { func(); }
+
+protected:
+	std::function<void()> func;
+};
+
+// counts the unfinished tasks of one job so the job can be waited for on a shared pool
+class FTaskGroup
+{
+public:
+	FTaskGroup() : pending(0) {}
+
+	int Pending() const { return pending.load(); }
+
+protected:
+	std::atomic<int> pending;
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	friend class FParallelSystem;
+};
+
+
+// task queue of one worker
+//   the owner pushes and pops at the back, thieves take from the front.
+struct alignas(64) FWorkQueue
+{
+	std::mutex mutex;
+	std::deque<FTask*> tasks;
 };
 
 
 // parallel system
+//   work stealing: every worker has its own queue, tasks added from a worker go to its queue,
+//   tasks added from other threads go to a shared injection queue. an idle worker takes from
+//   its own queue, then the injection queue, then steals from random workers before it parks.
+//   a new task wakes at most one parked worker.
 class FParallelSystem
 {
 public:
 	FParallelSystem();
+	~FParallelSystem();
 
-	void AddTask(FTask* inTask);
-	FTask* WaitForTask();
+	// inTask must stay alive until it is executed
+	void AddTask(FTask* inTask, FTaskGroup* inGroup = nullptr);
+	// next task for the worker, nullptr once terminated
+	FTask* WaitForTask(int worker);
 
-	void Start(int numthreads);
+	// bPinThreads pins every worker to one cpu, spreading the workers over the numa nodes.
+	// per worker state is allocated by the worker itself after pinning, so it is local to its node
+	void Start(int numthreads, bool bPinThreads = false);
 	void Terminate();
 	void WaitForFinish();
+	// wait until every added task has been executed
 	void WaitForEmpty();
+	// wait until every task of the group has been executed. called from a worker of this
+	// system it runs the group's tasks from its own queue meanwhile, so tasks may wait for
+	// the tasks they spawn. no other task runs inside Wait, it is safe under a lock or call_once
+	void Wait(FTaskGroup& group);
+
+	int NumThreads() const { return (int)_threads.size(); }
+	// the calling thread is one of our workers
+	bool IsWorkerThread() const;
+	// [0, NumThreads()) for our workers, -1 for other threads
+	int WorkerIndex() const;
+
+protected:
+	void RunWorker(int worker);
+	FTask* FindTask(int worker);
+	void RunTask(FTask* task);
+
+	static FTask* PopBack(FWorkQueue& queue);
+	static FTask* PopFront(FWorkQueue& queue);
+	// newest task of group in queue
+	static FTask* PopGroupTask(FWorkQueue& queue, const FTaskGroup* group);
 
 protected:
 	std::vector<std::thread>  _threads;
-	std::mutex	_mutex;
-	std::condition_variable _cv;
+	std::vector<std::unique_ptr<FWorkQueue>> _queues;
+	FWorkQueue _injected;
+
+	// tasks sitting in any queue
+	std::atomic<int> _queued;
+	// tasks added and not yet executed
+	std::atomic<int> _unfinished;
+
+	// parking of idle workers
+	std::mutex	_sleepMutex;
+	std::condition_variable _sleepCv;
+	std::atomic<int> _sleepers;
+
+	std::mutex	_doneMutex;
+	std::condition_variable _doneCv;
+	int _readyWorkers;
+	bool _bPinThreads;
 
-	volatile bool _bTerminateFlag;
-	std::vector<FTask*> _tasks;
+	std::atomic<bool> _bTerminateFlag;
 };
 
-} // namespace pbrt
 
+// tasks with dependencies
+//   a node is queued on the parallel system once all its dependencies have finished.
+//   nodes may be added before Start or by running nodes, dependencies that already
+//   finished are ignored.
+class FTaskGraph
+{
+public:
+	class FNode : public FTask
+	{
+	public:
+		virtual void Execute() override;
+
+	protected:
+		FTaskGraph* graph;
+		std::function<void()> func;
+
+		std::atomic<int> remaining;
+		std::mutex mutex;
+		std::vector<FNode*> dependents;
+		bool bFinished;
+
+		friend class FTaskGraph;
+	};
+
+	FTaskGraph(FParallelSystem& inParallel);
+	FTaskGraph();
+	~FTaskGraph();
+
+	FNode* Add(std::function<void()> func, const std::vector<FNode*>& dependencies = {});
+
+	void Start();
+	// starts the graph if needed and waits until every node has finished
+	void Wait();
+
+protected:
+	void Release(FNode* node);
+	void Finish(FNode* node);
+
+protected:
+	FParallelSystem& parallel;
+	FTaskGroup group;
+
+	std::mutex mutex;
+	std::deque<std::unique_ptr<FNode>> nodes;
+	bool bStarted;
+};
+
+
+// threads of the global parallel system, 0 uses one per hardware thread.
+// takes effect only before the first GlobalParallelSystem() call
+void SetParallelThreadsNum(int numthreads);
+int ParallelThreadsNum();
+// pin the workers of the global parallel system to cpus, same rule as above
+void SetParallelAffinity(bool bPinThreads);
+// chunk size for count items on the global parallel system
+int64_t ParallelGrainSize(int64_t count);
+
+// process wide pool shared by scene loading, bvh build, rendering and image output.
+// started on first use and kept until exit
+FParallelSystem& GlobalParallelSystem();
+
+
+//////////////////////////////////////////////////////////////////////////
+// numa
+
+int NumaNodesNum();
+// node of the calling thread if it is a pinned worker, otherwise 0
+int CurrentNumaNode();
+// run func on a thread pinned to the cpus of node and wait for it, memory it touches first is local to node
+void RunOnNumaNode(int node, const std::function<void()>& func);
+
+
+//////////////////////////////////////////////////////////////////////////
+// data parallel loops on the global parallel system
+//   the calling thread works too and returns when the whole range is done.
+//   chunk <= 0 picks a grain size that gives every thread several chunks to balance the load.
+
+// func(start, end) for consecutive chunks of [begin, end)
+void ParallelForRange(int64_t begin, int64_t end, int64_t chunk, const std::function<void(int64_t, int64_t)>& func);
+
+// func(i) for every i in [begin, end)
+template<typename Func>
+void ParallelFor(int64_t begin, int64_t end, int64_t chunk, const Func& func)
+{
+	ParallelForRange(begin, end, chunk, [&func](int64_t start, int64_t stop)
+	{
+		for (int64_t i = start; i < stop; ++i)
+		{
+			func(i);
+		}
+	});
+}
+
+// func(startx, starty, endx, endy) for every tile x tile block of a width x height grid
+template<typename Func>
+void ParallelFor2D(int width, int height, int tile, const Func& func)
+{
+	const int numx = (width + tile - 1) / tile;
+	const int numy = (height + tile - 1) / tile;
+
+	ParallelFor(0, (int64_t)numx * numy, 1, [&](int64_t index)
+	{
+		int x = (int)(index % numx) * tile;
+		int y = (int)(index / numx) * tile;
+
+		func(x, y, std::min(x + tile, width), std::min(y + tile, height));
+	});
+}
+
+// combine(func(start, end)...) over chunks of [begin, end), combined in chunk order so the result
+// does not depend on the scheduling
+template<typename T, typename Func, typename Combine>
+T ParallelReduce(int64_t begin, int64_t end, int64_t chunk, const T& identity, const Func& func, const Combine& combine)
+{
+	if (end <= begin)
+		return identity;
+
+	if (chunk <= 0)
+	{
+		chunk = ParallelGrainSize(end - begin);
+	}
+
+	const int64_t numchunks = (end - begin + chunk - 1) / chunk;
+	std::vector<T> partial(numchunks, identity);
+
+	ParallelFor(0, numchunks, 1, [&](int64_t c)
+	{
+		int64_t start = begin + c * chunk;
+		partial[c] = func(start, std::min(start + chunk, end));
+	});
+
+	T result = identity;
+	for (const T& value : partial)
+	{
+		result = combine(result, value);
+	}
+
+	return result;
+}
+
+} // namespace pbrt
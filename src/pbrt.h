@@ -9,6 +9,7 @@
 #include <cstdarg>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include <climits>
 #include <cassert>
 #include <iosfwd>
@@ -85,6 +86,86 @@ inline T Clamp(T val, U low, V high) {
 inline Float Degree2Rad(Float x) { return (x * kPi) / (Float)180; }
 inline Float Rad2Degree(Float x) { return (x * (Float)180) / kPi; }
 
+// IEEE 754 half precision float <--> float, round to nearest even
+inline uint16_t FloatToHalf(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t biased = (x >> 23) & 0xff;
+	uint32_t mantissa = x & 0x007fffff;
+
+	if (biased == 0xff) // inf or nan
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+	int exponent = (int)biased - 127 + 15;
+	if (exponent >= 31) // overflow
+		return (uint16_t)(sign | 0x7c00);
+
+	if (exponent <= 0)
+	{
+		// subnormal half or zero
+		if (exponent < -10)
+			return (uint16_t)sign;
+
+		mantissa |= 0x00800000;
+		const uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+
+	// a carry out of the mantissa correctly bumps the exponent
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	const uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return (uint16_t)half;
+}
+
+inline float HalfToFloat(uint16_t h)
+{
+	const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	uint32_t x;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+		{
+			x = sign;
+		}
+		else
+		{
+			// normalize the subnormal
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if (exponent == 31)
+	{
+		x = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
 // https://stackoverflow.com/questions/17333/what-is-the-most-effective-way-for-float_t-and-double-comparison
 // http://realtimecollisiondetection.net/blog/?p=89
 template <typename T>
@@ -0,0 +1,131 @@
+// \brief
+//		pooled storage for scene objects, addressed by 32 bit handles
+//
+
+#pragma once
+
+#include "pbrt.h"
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+
+
+namespace pbrt
+{
+
+// index of an object in its pool or table
+typedef uint32_t FHandle;
+const FHandle InvalidHandle = 0xffffffff;
+
+
+class FPoolBase
+{
+public:
+	virtual ~FPoolBase() {}
+};
+
+// pool
+//   objects of one type constructed in place in chunks of contiguous storage. chunks never move,
+//   so pointers and handles stay valid for the life of the pool. objects are only destroyed with the pool.
+template<typename T, uint32_t ChunkSize = 1024>
+class TPool : public FPoolBase
+{
+public:
+	TPool() : count(0) {}
+
+	virtual ~TPool() override
+	{
+		for (FHandle handle = 0; handle < count; ++handle)
+		{
+			(*this)[handle].~T();
+		}
+	}
+
+	TPool(const TPool&) = delete;
+	TPool& operator=(const TPool&) = delete;
+
+	template<typename ...U>
+	FHandle Add(U&& ... args)
+	{
+		if (count % ChunkSize == 0)
+		{
+			chunks.push_back(std::unique_ptr<FSlot[]>(new FSlot[ChunkSize]));
+		}
+
+		new (&chunks[count / ChunkSize][count % ChunkSize]) T(std::forward<U>(args)...);
+		return count++;
+	}
+
+	T& operator[](FHandle handle)
+	{
+		return *reinterpret_cast<T*>(&chunks[handle / ChunkSize][handle % ChunkSize]);
+	}
+
+	const T& operator[](FHandle handle) const
+	{
+		return *reinterpret_cast<const T*>(&chunks[handle / ChunkSize][handle % ChunkSize]);
+	}
+
+	uint32_t Size() const { return count; }
+
+	size_t MemorySize() const { return chunks.size() * ChunkSize * sizeof(FSlot); }
+
+protected:
+	struct alignas(T) FSlot
+	{
+		uint8_t bytes[sizeof(T)];
+	};
+
+	std::vector<std::unique_ptr<FSlot[]>> chunks;
+	uint32_t count;
+};
+
+
+// one pool per object type, created on first use
+class FPoolSet
+{
+public:
+	template<typename T>
+	TPool<T>& Pool()
+	{
+		const size_t id = TypeId<T>();
+		if (id >= pools.size())
+		{
+			pools.resize(id + 1);
+		}
+
+		if (!pools[id])
+		{
+			pools[id] = std::make_unique<TPool<T>>();
+		}
+
+		return static_cast<TPool<T>&>(*pools[id]);
+	}
+
+	template<typename T, typename ...U>
+	T* Create(U&& ... args)
+	{
+		TPool<T>& pool = Pool<T>();
+		return &pool[pool.Add(std::forward<U>(args)...)];
+	}
+
+protected:
+	template<typename T>
+	static size_t TypeId()
+	{
+		static const size_t id = NextTypeId();
+		return id;
+	}
+
+	static size_t NextTypeId()
+	{
+		static std::atomic<size_t> next(0);
+		return next++;
+	}
+
+	std::vector<std::unique_ptr<FPoolBase>> pools;
+};
+
+} // namespace pbrt
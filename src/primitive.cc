@@ -3,4 +3,26 @@
 //
 
 #include "primitive.h"
+#include "scene.h"
+
+
+namespace pbrt
+{
+
+FBSDF* FPrimitive::GetBsdf(const FScene& scene, const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const
+{
+	return material != InvalidHandle ? scene.Material(material)->Scattering(isect, sampler, arena) : nullptr;
+}
+
+FColor FPrimitive::GetLe(const FScene& scene, const FIntersection& isect) const
+{
+	return arealight != InvalidHandle ? scene.AreaLight(arealight)->L(FLightIntersection(isect.position, isect.normal), isect.wo) : FColor::Black;
+}
+
+const FAreaLight* FPrimitive::GetAreaLight(const FScene& scene) const
+{
+	return arealight != InvalidHandle ? scene.AreaLight(arealight) : nullptr;
+}
+
+} // namespace pbrt
 
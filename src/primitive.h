@@ -10,33 +10,43 @@
 #include "material.h"
 #include "light.h"
 #include "bvh.h"
+#include "pool.h"
 
 
 namespace pbrt
 {
 
 	
+	class FScene;
+
+	typedef FHandle FShapeHandle;
+	typedef FHandle FMaterialHandle;
+	typedef FHandle FLightHandle;
+	typedef FHandle FPrimitiveHandle;
+
 	// primitive in scene
+	//   kept in a pool of the scene. the shape stays a pointer for the bvh traversal, the material
+	//   and the area light are handles into the scene tables, only resolved for shading
 	class FPrimitive
 	{
 	public:
 		const FShape* shape;
-		const FMaterial* material;
-		const FAreaLight* arealight;
+		FMaterialHandle material;
+		FLightHandle arealight;
 
 		FPrimitive()
 			: shape(nullptr)
-			, material(nullptr)
-			, arealight(nullptr)
+			, material(InvalidHandle)
+			, arealight(InvalidHandle)
 		{}
 
-		FPrimitive(const FShape* inShape, const FMaterial* inMaterial, const FAreaLight* inLight)
+		FPrimitive(const FShape* inShape, FMaterialHandle inMaterial, FLightHandle inLight)
 			: shape(inShape)
 			, material(inMaterial)
 			, arealight(inLight)
 		{}
 
-		virtual bool Intersect(const FRay& ray, FIntersection& oisect) const
+		bool Intersect(const FRay& ray, FIntersection& oisect) const
 		{
 			bool bHit = shape->Intersect(ray, oisect);
 			if (bHit)
@@ -47,20 +57,25 @@ namespace pbrt
 			return bHit;
 		}
 
-		virtual const FBounds3& WorldBounds() const
+		bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
 		{
-			return shape->WorldBounds();
-		}
+			bool bHit = shape->Traverse(ray, oisect, stack, visited);
+			if (bHit)
+			{
+				oisect.primitive = this;
+			}
 
-		std::unique_ptr<FBSDF> GetBsdf(const FIntersection& isect, FSampler* sampler) const
-		{
-			return material ? material->Scattering(isect, sampler) : nullptr;
+			return bHit;
 		}
 
-		FColor GetLe(const FIntersection& isect) const
+		const FBounds3& WorldBounds() const
 		{
-			return arealight ? arealight->L(FLightIntersection(isect.position, isect.normal), isect.wo) : FColor::Black;
+			return shape->WorldBounds();
 		}
+
+		FBSDF* GetBsdf(const FScene& scene, const FIntersection& isect, FSampler* sampler, FMemoryArena& arena) const;
+		FColor GetLe(const FScene& scene, const FIntersection& isect) const;
+		const FAreaLight* GetAreaLight(const FScene& scene) const;
 	};
 
 } // namespace pbrt
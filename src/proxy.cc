@@ -0,0 +1,269 @@
+// \brief
+//		proxy.cc
+//
+
+#include "proxy.h"
+
+
+namespace pbrt
+{
+
+// geometry pinned by a render thread for the rest of its tile, indexed by FTriangleMeshProxy::pinSlot
+static std::atomic<uint32_t> g_proxyPinSlots(0);
+static thread_local std::vector<std::shared_ptr<FProxyGeometry>> tls_proxyPins;
+
+FTriangleMeshProxy::FTriangleMeshProxy(FGeometryCache* inCache, const char* inFilename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale, bool bCleanup, int compression, bool bScanBounds)
+	: cache(inCache)
+	, filename(inFilename)
+	, bFlipNormal(flip_normal)
+	, bFlipHandedness(bFlipHandedness)
+	, offset(offset)
+	, scale(inScale)
+	, bCleanup(bCleanup)
+	, compression(compression)
+	, residency(std::make_unique<FProxyResidency[]>(NumaNodesNum()))
+	, pinSlot(g_proxyPinSlots.fetch_add(1, std::memory_order_relaxed))
+{
+	if (bScanBounds)
+	{
+		ScanTriangleMeshBounds(inFilename, worldBox, bFlipHandedness, offset, inScale);
+	}
+}
+
+bool FTriangleMeshProxy::Intersect(const FRay& ray, FIntersection& oisect) const
+{
+	if (!worldBox.Intersect(ray))
+		return false;
+
+	const FProxyGeometry* loaded = Pin();
+	if (!loaded->mesh || !loaded->mesh->Intersect(ray, oisect))
+		return false;
+
+	// the mesh may be evicted once the tile is finished
+	oisect.ComputeShadingNormal();
+	return true;
+}
+
+bool FTriangleMeshProxy::Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+{
+	if (!worldBox.Intersect(ray))
+		return false;
+
+	// the pin keeps the geometry alive while its nodes are on the stack
+	const FProxyGeometry* loaded = Pin();
+	if (!loaded->mesh || !loaded->mesh->Traverse(ray, oisect, stack, visited))
+		return false;
+
+	// the mesh may be evicted once the tile is finished
+	oisect.ComputeShadingNormal();
+	return true;
+}
+
+const FProxyGeometry* FTriangleMeshProxy::Pin() const
+{
+	if (pinSlot >= tls_proxyPins.size())
+	{
+		tls_proxyPins.resize(pinSlot + 1);
+	}
+
+	// geometry evicted while pinned stays in use until the tile is finished, acquiring it again
+	// would only evict the other geometry the tile holds
+	std::shared_ptr<FProxyGeometry>& pin = tls_proxyPins[pinSlot];
+	if (!pin)
+	{
+		pin = cache->Acquire(this);
+	}
+
+	return pin.get();
+}
+
+FLightIntersection FTriangleMeshProxy::SamplePosition(const FFloat2& random, Float* out_pdf) const
+{
+	PBRT_ERROR("FTriangleMeshProxy can not be sampled as a light. %s\n", filename.c_str());
+
+	*out_pdf = 0;
+	return FLightIntersection();
+}
+
+FTaskGraph::FNode* FTriangleMeshProxy::Preload(FTaskGraph& graph)
+{
+	std::shared_ptr<std::shared_ptr<FProxyGeometry>> loaded = std::make_shared<std::shared_ptr<FProxyGeometry>>();
+
+	FTaskGraph::FNode* load = graph.Add([this, loaded]()
+	{
+		*loaded = LoadMesh();
+	});
+
+	return graph.Add([this, loaded]()
+	{
+		BuildBVH(**loaded, true);
+
+		if ((*loaded)->mesh)
+		{
+			worldBox.Expand((*loaded)->mesh->Bounds());
+		}
+
+		cache->Store(this, *loaded);
+	}, { load });
+}
+
+std::shared_ptr<FProxyGeometry> FTriangleMeshProxy::Load(int node) const
+{
+	// called by a traversal under the loadMutex of the node, the build must not wait on pool tasks.
+	// the calling thread runs on the node, so the copy is allocated in its memory
+	for (int other = 0; other < NumaNodesNum(); ++other)
+	{
+		if (other == node)
+			continue;
+
+		std::shared_ptr<FProxyGeometry> source = std::atomic_load(&residency[other].geometry);
+		if (source && source->mesh)
+		{
+			std::shared_ptr<FProxyGeometry> loaded = std::make_shared<FProxyGeometry>();
+			loaded->mesh = source->mesh->CreateReplica(cache->BVHLazyDepth());
+			loaded->bytes = loaded->mesh->MemorySize();
+			return loaded;
+		}
+	} // end for other
+
+	std::shared_ptr<FProxyGeometry> loaded = LoadMesh();
+	BuildBVH(*loaded, false);
+
+	return loaded;
+}
+
+std::shared_ptr<FProxyGeometry> FTriangleMeshProxy::LoadMesh() const
+{
+	std::shared_ptr<FProxyGeometry> loaded = std::make_shared<FProxyGeometry>();
+
+	LoadTriangleMesh(filename.c_str(), loaded->mesh, bFlipNormal, bFlipHandedness, offset, scale, bCleanup, compression);
+
+	return loaded;
+}
+
+void FTriangleMeshProxy::BuildBVH(FProxyGeometry& loaded, bool bParallel) const
+{
+	if (!loaded.mesh)
+		return;
+
+	loaded.mesh->BuildBVH(cache->BVHLazyDepth(), bParallel);
+	loaded.bytes = loaded.mesh->MemorySize();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// geometry cache
+
+void FGeometryCache::SetMemoryBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	budget = bytes;
+	EvictOverBudget(nullptr);
+}
+
+std::shared_ptr<FProxyGeometry> FGeometryCache::Acquire(const FTriangleMeshProxy* proxy)
+{
+	const int node = bReplicate ? CurrentNumaNode() : 0;
+	FProxyResidency& slot = proxy->residency[node];
+
+	const uint64_t now = epoch.load(std::memory_order_relaxed);
+	if (slot.lastUse.load(std::memory_order_relaxed) != now)
+	{
+		slot.lastUse.store(now, std::memory_order_relaxed);
+	}
+
+	std::shared_ptr<FProxyGeometry> loaded = std::atomic_load(&slot.geometry);
+	if (loaded)
+		return loaded;
+
+	// one loader per proxy and node, other threads entering the same box wait here
+	std::lock_guard<std::mutex> lock(slot.loadMutex);
+
+	loaded = std::atomic_load(&slot.geometry);
+	if (loaded)
+		return loaded;
+
+	loaded = proxy->Load(node);
+	std::atomic_store(&slot.geometry, loaded);
+
+	Insert(proxy, node, loaded->bytes);
+	return loaded;
+}
+
+void FGeometryCache::FinishTile()
+{
+	for (std::shared_ptr<FProxyGeometry>& pin : tls_proxyPins)
+	{
+		pin = nullptr;
+	}
+
+	epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FGeometryCache::Store(const FTriangleMeshProxy* proxy, const std::shared_ptr<FProxyGeometry>& loaded)
+{
+	FProxyResidency& slot = proxy->residency[0];
+	std::lock_guard<std::mutex> lock(slot.loadMutex);
+
+	if (std::atomic_load(&slot.geometry))
+		return;
+
+	std::atomic_store(&slot.geometry, loaded);
+	Insert(proxy, 0, loaded->bytes);
+}
+
+void FGeometryCache::Insert(const FTriangleMeshProxy* proxy, int node, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	proxy->residency[node].lastUse.store(++epoch, std::memory_order_relaxed);
+	resident.push_back({ proxy, node });
+	residentBytes += bytes;
+	loads++;
+
+	const FResident keep = { proxy, node };
+	EvictOverBudget(&keep);
+}
+
+void FGeometryCache::EvictOverBudget(const FResident* keep)
+{
+	// caller holds the mutex
+	while (budget > 0 && residentBytes > budget)
+	{
+		int victim = -1;
+		uint64_t oldest = 0;
+		for (int i = 0; i < (int)resident.size(); ++i)
+		{
+			if (keep && resident[i].proxy == keep->proxy && resident[i].node == keep->node)
+				continue;
+
+			uint64_t stamp = resident[i].proxy->residency[resident[i].node].lastUse.load(std::memory_order_relaxed);
+			if (victim < 0 || stamp < oldest)
+			{
+				victim = i;
+				oldest = stamp;
+			}
+		} // end for i
+
+		if (victim < 0)
+			break;
+
+		FProxyResidency& slot = resident[victim].proxy->residency[resident[victim].node];
+		std::shared_ptr<FProxyGeometry> loaded = std::atomic_load(&slot.geometry);
+
+		residentBytes -= loaded ? loaded->bytes : 0;
+		resident.erase(resident.begin() + victim);
+		std::atomic_store(&slot.geometry, std::shared_ptr<FProxyGeometry>());
+		evictions++;
+	} // end while
+}
+
+void FGeometryCache::PrintStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	PBRT_PRINT("geometry cache: %d loads, %d evictions, %d resident (%.2f MB), budget %.2f MB\n",
+		loads, evictions, (int)resident.size(), residentBytes / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+}
+
+} // namespace pbrt
@@ -0,0 +1,155 @@
+// \brief
+//		out-of-core geometry: lazily loaded mesh proxies
+//
+
+#pragma once
+
+#include "pbrt.h"
+#include "geometry.h"
+#include "shape.h"
+#include "bvh.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <mutex>
+
+
+namespace pbrt
+{
+
+class FGeometryCache;
+
+// geometry of a loaded proxy
+struct FProxyGeometry
+{
+	// null if loading failed. the mesh holds its bvh
+	std::shared_ptr<FTriangleMesh> mesh;
+
+	size_t bytes = 0;
+};
+
+// residency of a proxy on one numa node
+struct FProxyResidency
+{
+	// geometry is read and written with std::atomic_load/atomic_store
+	std::mutex loadMutex;
+	std::shared_ptr<FProxyGeometry> geometry;
+	std::atomic<uint64_t> lastUse{ 0 };
+};
+
+// triangle mesh proxy
+//   only holds the bounding box until a ray first enters it, then the mesh is loaded and
+//   its bvh built under a lock. the geometry cache may evict it again under a memory budget.
+//   a render thread pins the geometry on its first ray through the proxy and keeps it until the
+//   end of the tile, see FGeometryCache::FinishTile. with replication each numa node holds its own
+//   copy, see FGeometryCache::SetReplication. a proxy can not be used as an area light.
+class FTriangleMeshProxy : public FShape
+{
+public:
+	// bScanBounds false leaves the bounds empty until the proxy is loaded, see Preload
+	FTriangleMeshProxy(FGeometryCache* inCache, const char* inFilename, bool flip_normal = false, bool bFlipHandedness = false,
+		const FVector3& offset = FVector3(0, 0, 0), Float inScale = 1.f, bool bCleanup = false, int compression = MeshCompressNone, bool bScanBounds = true);
+
+	bool Intersect(const FRay& ray, FIntersection& oisect) const override;
+	bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const override;
+
+	Float Area() const override { return 0; }
+	FLightIntersection SamplePosition(const FFloat2& random, Float* out_pdf) const override;
+
+	bool IsResident(int node = 0) const { return std::atomic_load(&residency[node].geometry) != nullptr; }
+
+	// load the mesh and then build its bvh as two nodes of the graph, the bounds are set by the build.
+	// returns the build node
+	FTaskGraph::FNode* Preload(FTaskGraph& graph);
+
+protected:
+	// copies the geometry resident on another node if there is one, otherwise loads the file
+	std::shared_ptr<FProxyGeometry> Load(int node) const;
+	std::shared_ptr<FProxyGeometry> LoadMesh() const;
+	// with the lazy depth of the cache. bParallel false builds on the calling thread, see FBVH_Node
+	void BuildBVH(FProxyGeometry& loaded, bool bParallel) const;
+
+	// the geometry pinned by the calling thread. acquired from the cache on the first call of a tile,
+	// otherwise a plain lookup
+	const FProxyGeometry* Pin() const;
+
+	friend class FGeometryCache;
+
+protected:
+	FGeometryCache* cache;
+
+	std::string filename;
+	bool	bFlipNormal;
+	bool	bFlipHandedness;
+	FVector3 offset;
+	Float	scale;
+	bool	bCleanup;
+	int		compression;
+
+	// one per numa node, only the first is used without replication
+	std::unique_ptr<FProxyResidency[]> residency;
+
+	// index of the proxy in the pins of a thread, unique over all caches
+	uint32_t pinSlot;
+};
+
+// owns the resident proxy geometry, evicts the least recently used proxies when over budget.
+// evicted geometry stays alive until every thread that pinned it has finished its tile.
+// the budget covers the copies of all numa nodes.
+class FGeometryCache
+{
+public:
+	FGeometryCache()
+		: budget(0)
+		, lazyDepth(-1)
+		, bReplicate(false)
+		, residentBytes(0)
+		, epoch(0)
+		, loads(0)
+		, evictions(0)
+	{}
+
+	// in bytes, 0 is unlimited
+	void SetMemoryBudget(size_t bytes);
+	size_t MemoryBudget() const { return budget; }
+	// lazyDepth of the mesh bvhs of proxies loaded after this call, see FBVH_Node
+	void SetBVHLazyDepth(int depth) { lazyDepth = depth; }
+	int BVHLazyDepth() const { return lazyDepth; }
+	// load a copy of the geometry per numa node, used by the threads of that node. geometry already
+	// resident is copied instead of loaded again
+	void SetReplication(bool bEnable) { bReplicate = bEnable; }
+
+	std::shared_ptr<FProxyGeometry> Acquire(const FTriangleMeshProxy* proxy);
+	// called by a render thread after each tile, drops the geometry the thread pinned and ticks the lru clock
+	void FinishTile();
+	// make geometry loaded outside of Acquire resident on the first numa node
+	void Store(const FTriangleMeshProxy* proxy, const std::shared_ptr<FProxyGeometry>& loaded);
+
+	void PrintStats() const;
+
+protected:
+	struct FResident
+	{
+		const FTriangleMeshProxy* proxy;
+		int node;
+	};
+
+	void Insert(const FTriangleMeshProxy* proxy, int node, size_t bytes);
+	void EvictOverBudget(const FResident* keep);
+
+protected:
+	mutable std::mutex mutex;
+	std::vector<FResident> resident;
+	size_t budget;
+	int lazyDepth;
+	bool bReplicate;
+	size_t residentBytes;
+
+	// clock of the lru, ticks after every tile and on every load. a proxy is stamped when a tile first pins it
+	std::atomic<uint64_t> epoch;
+
+	int loads;
+	int evictions;
+};
+
+} // namespace pbrt
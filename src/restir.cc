@@ -0,0 +1,417 @@
+// \brief
+//		restir.cc
+//
+
+#include "restir.h"
+#include "parallel.h"
+
+
+namespace pbrt
+{
+
+void FReSTIRIntegrator::Render(const FScene* scene, FSampler* sampler, FFilm* film, bool bParallel) const
+{
+	const int width = film->Width();
+	const int height = film->Height();
+	const int passes = sampler->GetSamplesPerPixel();
+	const FCamera* pCamera = scene->Camera();
+
+	FPerformanceCounter perf;
+	perf.StartPerf();
+
+	PBRT_PRINT("start rendering ...\n");
+
+	// one context per worker as in FIntegrator::Render. the arenas keep the bsdfs of a whole pass,
+	// the spatial reuse evaluates them after all pixels are traced
+	FParallelSystem& parallel = GlobalParallelSystem();
+	std::vector<std::unique_ptr<FThreadContext>> contexts(bParallel ? parallel.NumThreads() + 1 : 1);
+
+	auto ThreadContext = [&]() -> FThreadContext&
+	{
+		std::unique_ptr<FThreadContext>& context = contexts[bParallel ? parallel.WorkerIndex() + 1 : 0];
+		if (!context)
+		{
+			context = std::make_unique<FThreadContext>(sampler->Clone());
+			RequestSamples(scene, context->Sampler());
+		}
+
+		return *context;
+	};
+
+	const int tile = ChooseTileSize(width, height, bParallel ? ParallelThreadsNum() : 1);
+	auto ForTiles = [&](const auto& func)
+	{
+		if (bParallel)
+		{
+			ParallelFor2D(width, height, tile, [&](int startx, int starty, int endx, int endy)
+			{
+				func(startx, starty, endx, endy);
+				scene->FinishTile();
+			});
+		}
+		else
+		{
+			func(0, 0, width, height);
+			scene->FinishTile();
+		}
+	};
+
+	// the surfaces and reservoirs of this pass, and of the previous one for the temporal reuse
+	std::vector<FSurface> surfaces(width * height), prevSurfaces(width * height);
+	std::vector<FReservoir> reservoirs(width * height), history(width * height);
+	std::vector<FColor> sums(width * height);
+
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		// candidates and temporal reuse
+		ForTiles([&](int startx, int starty, int endx, int endy)
+		{
+			FThreadContext& context = ThreadContext();
+			FSampler* pixelSampler = context.Sampler();
+
+			for (int y = starty; y < endy; y++)
+			{
+				for (int x = startx; x < endx; x++)
+				{
+					const int index = y * width + x;
+					pixelSampler->StartPixelSample(x, y, pass);
+
+					auto camera_sample = pixelSampler->GetCameraSample(FPoint2((Float)x, (Float)y));
+					FRay ray = pCamera->GenerateRay(camera_sample);
+					++context.stats.cameraRays;
+
+					FSurface& surface = surfaces[index];
+					surface = FSurface();
+					sums[index] += TraceSurface(ray, scene, context, surface);
+					if (!surface.bsdf)
+					{
+						reservoirs[index] = FReservoir();
+						continue;
+					}
+
+					FReservoir r = SampleCandidates(surface, scene, context);
+					if (bTemporal && pass > 0 && Similar(surface, prevSurfaces[index]))
+					{
+						// a bounded history keeps following changes of the target pdf
+						FReservoir prev = history[index];
+						prev.M = std::min(prev.M, 20 * r.M);
+
+						FReservoir merged;
+						merged.Merge(r, TargetPdf(surface, r.y), pixelSampler->GetFloat());
+						merged.Merge(prev, TargetPdf(surface, prev.y), pixelSampler->GetFloat());
+						merged.Finalize(TargetPdf(surface, merged.y));
+						r = merged;
+					}
+
+					reservoirs[index] = r;
+				} // end x
+			} // end y
+		});
+
+		// spatial reuse and shading, the result is the history of the next pass
+		ForTiles([&](int startx, int starty, int endx, int endy)
+		{
+			FThreadContext& context = ThreadContext();
+			std::vector<int> merged;
+			merged.reserve(spatialNum + 1);
+
+			for (int y = starty; y < endy; y++)
+			{
+				for (int x = startx; x < endx; x++)
+				{
+					const int index = y * width + x;
+					const FSurface& surface = surfaces[index];
+					if (!surface.bsdf)
+					{
+						history[index] = FReservoir();
+						continue;
+					}
+
+					// a stream apart from the sampler's, which the candidates already used
+					FRNG rng(MixBits(HashInts((uint64_t)x, (uint64_t)y, (uint64_t)pass)));
+
+					merged.assign(1, index);
+					for (int i = 0; i < spatialNum; ++i)
+					{
+						FPoint2 offset = spatialRadius * uniform_disk_sample(rng.uniform_float2());
+						int nx = x + (int)std::round(offset.x);
+						int ny = y + (int)std::round(offset.y);
+						if (nx < 0 || nx >= width || ny < 0 || ny >= height || (nx == x && ny == y))
+							continue;
+
+						const int nindex = ny * width + nx;
+						if (Similar(surface, surfaces[nindex]))
+						{
+							merged.push_back(nindex);
+						}
+					} // end for i
+
+					// each reservoir is weighted by the balance heuristic over the target pdfs of all merged
+					// pixels instead of by its share of M. a neighbor whose lights differ (or the top of a
+					// light next to a floor, which samples nothing) then takes little weight, where equal
+					// weights would add its noise or darken the pixel.
+					// https://research.nvidia.com/publication/2022-07_generalized-resampled-importance-sampling-foundations-restir
+					FReservoir r;
+					for (int k : merged)
+					{
+						const FReservoir& rk = reservoirs[k];
+						r.M += rk.M;
+						if (rk.W == 0)
+							continue;
+
+						Float mis = 0;
+						for (int j : merged)
+						{
+							mis += reservoirs[j].M * TargetPdf(surfaces[j], rk.y);
+						}
+
+						const Float pHat = TargetPdf(surface, rk.y);
+						const Float weight = mis > 0 ? rk.M * TargetPdf(surfaces[k], rk.y) / mis * pHat * rk.W : 0;
+						r.wSum += weight;
+						if (weight > 0 && rng.uniform_float() * r.wSum < weight)
+						{
+							r.y = rk.y;
+						}
+					} // end for k
+
+					// the mis weights sum to one, no division by M
+					const Float pHat = TargetPdf(surface, r.y);
+					r.W = pHat > 0 ? r.wSum / pHat : 0;
+
+					sums[index] += Shade(surface, r, scene, context);
+					history[index] = r;
+				} // end x
+			} // end y
+		});
+
+		// nothing refers to the bsdfs of this pass anymore
+		for (const auto& context : contexts)
+		{
+			if (context)
+			{
+				context->Arena().Reset();
+			}
+		}
+
+		std::swap(surfaces, prevSurfaces);
+	} // end for pass
+
+	const Float ratio = (Float)1 / passes;
+	film->ClearEncoded();
+	ForTiles([&](int startx, int starty, int endx, int endy)
+	{
+		for (int y = starty; y < endy; y++)
+		{
+			for (int x = startx; x < endx; x++)
+			{
+				film->AddColor(x, y, Clamp01(sums[y * width + x] * ratio));
+			}
+		}
+
+		film->EncodeTile(startx, starty, endx, endy);
+	});
+
+	FRenderStats stats;
+	for (const auto& context : contexts)
+	{
+		if (context)
+		{
+			stats += context->stats;
+		}
+	}
+
+	PrintRenderStats(stats, perf.EndPerf());
+}
+
+FColor FReSTIRIntegrator::Li(const FRay& ray, const FScene* scene, FThreadContext& context) const
+{
+	FSurface surface;
+	FColor L = TraceSurface(ray, scene, context, surface);
+	if (surface.bsdf)
+	{
+		L += Shade(surface, SampleCandidates(surface, scene, context), scene, context);
+	}
+
+	return L;
+}
+
+FColor FReSTIRIntegrator::TraceSurface(const FRay& inRay, const FScene* scene, FThreadContext& context, FSurface& surface) const
+{
+	FColor L(0, 0, 0), beta(1, 1, 1);
+	FRay ray(inRay);
+	Float depth = 0;
+
+	for (int bounces = 0; ; ++bounces)
+	{
+		FIntersection isect;
+		if (!scene->Intersect(ray, isect, context))
+		{
+			for (const auto& light : scene->InfiniteLights())
+				L += beta * light->Le(ray);
+
+			break;
+		}
+
+		// the emission seen by the camera or through specular bounces, no light sample reaches it
+		L += beta * isect.Le(*scene);
+		depth += Distance(ray.Origin(), isect.position);
+
+		FBSDF* bsdfptr = isect.Bsdf(*scene, context.Sampler(), context.Arena());
+		if (!bsdfptr) {
+			ray = isect.SpawnRay(ray.Dir());
+			--bounces;
+			continue;
+		}
+
+		if (!bsdfptr->IsDelta())
+		{
+			surface.isect = isect;
+			surface.bsdf = bsdfptr;
+			surface.beta = beta;
+			surface.depth = depth;
+			break;
+		}
+
+		if (bounces >= maxDepth)
+		{
+			break;
+		}
+
+		FBSDFSample bsdfsample = bsdfptr->Sample(isect.wo, context.Sampler()->GetFloat2());
+		if (bsdfsample.f.IsBlack() || bsdfsample.pdf == 0.f)
+		{
+			break;
+		}
+
+		beta *= bsdfsample.f * AbsDot(bsdfsample.wi, isect.normal) / bsdfsample.pdf;
+		ray = isect.SpawnRay(bsdfsample.wi);
+	} // end for
+
+	return L;
+}
+
+FReservoir FReSTIRIntegrator::SampleCandidates(const FSurface& surface, const FScene* scene, FThreadContext& context) const
+{
+	FSampler* sampler = context.Sampler();
+	const FLightSampler* lightSampler = scene->LightSampler();
+	const FIntersection& isect = surface.isect;
+
+	FReservoir r;
+	for (int i = 0; i < candidatesNum; ++i)
+	{
+		Float ulight = sampler->GetFloat();
+		FFloat2 u = sampler->GetFloat2();
+		Float uselect = sampler->GetFloat();
+
+		// a failed candidate still counts in M
+		FLightVertex x;
+		Float pdf = 0;
+
+		FSampledLight sampled = lightSampler->Sample(isect, ulight);
+		if (sampled.light && sampled.pmf > 0)
+		{
+			FLightSample lightsample = sampled.light->Sample_Li(isect, u);
+			if (!lightsample.Li.IsBlack() && lightsample.pdf > 0)
+			{
+				x.light = sampled.light;
+				x.pos = lightsample.pos;
+				x.normal = lightsample.normal;
+				x.wi = lightsample.wi;
+				pdf = sampled.pmf * lightsample.pdf;
+
+				// area lights are resampled by area, the measure that stays the same at other shading points
+				if (x.light->Flags() & eLightFlags::AreaLight)
+				{
+					pdf *= AbsDot(lightsample.normal, lightsample.wi) / Distance2(lightsample.pos, isect.position);
+				}
+			}
+		}
+
+		r.Update(x, pdf > 0 ? TargetPdf(surface, x) / pdf : 0, uselect);
+	} // end for i
+
+	r.Finalize(TargetPdf(surface, r.y));
+
+	// visibility reuse: an occluded sample is not passed on to the neighbors
+	if (r.W > 0 && Occluded(surface, r.y, scene, context))
+	{
+		r.W = 0;
+	}
+
+	return r;
+}
+
+FColor FReSTIRIntegrator::Contribution(const FSurface& surface, const FLightVertex& y) const
+{
+	if (!y.light)
+		return FColor::Black;
+
+	const FIntersection& isect = surface.isect;
+	const int flags = y.light->Flags();
+
+	FVector3 wi;
+	FColor Li;
+	if (flags & eLightFlags::AreaLight)
+	{
+		FVector3 d = y.pos - isect.position;
+		Float dist2 = d.Length2();
+		if (dist2 == 0)
+			return FColor::Black;
+
+		wi = d / std::sqrt(dist2);
+		Li = static_cast<const FAreaLight*>(y.light)->L(FLightIntersection(y.pos, y.normal), -wi) * AbsDot(y.normal, wi) / dist2;
+	}
+	else if (flags & eLightFlags::InfiniteLight)
+	{
+		wi = y.wi;
+		Li = y.light->Le(FRay(isect.position, wi));
+	}
+	else
+	{
+		// delta lights give the same sample whatever the random numbers
+		FLightSample lightsample = y.light->Sample_Li(isect, FFloat2(0, 0));
+		wi = lightsample.wi;
+		Li = lightsample.Li;
+	}
+
+	return surface.bsdf->Evalf(isect.wo, wi) * Li * AbsDot(wi, isect.normal);
+}
+
+bool FReSTIRIntegrator::Occluded(const FSurface& surface, const FLightVertex& y, const FScene* scene, FThreadContext& context) const
+{
+	const FIntersection& isect = surface.isect;
+	if (y.light->IsFinite())
+	{
+		return scene->Occluded(isect, y.pos, context);
+	}
+
+	// lights at infinity are beyond the scene bounds in direction wi
+	FPoint3 center;
+	Float radius;
+	scene->WorldBound().BoundingSphere(center, radius);
+
+	return scene->Occluded(isect.position, isect.normal, y.wi, 2 * radius, context);
+}
+
+bool FReSTIRIntegrator::Similar(const FSurface& a, const FSurface& b) const
+{
+	if (!b.bsdf)
+		return false;
+
+	// the thresholds of the paper: normals within 25 degrees, depths within 10%
+	return Dot(a.isect.normal, b.isect.normal) > (Float)0.906 && std::abs(a.depth - b.depth) <= (Float)0.1 * a.depth;
+}
+
+FColor FReSTIRIntegrator::Shade(const FSurface& surface, const FReservoir& r, const FScene* scene, FThreadContext& context) const
+{
+	if (r.W == 0 || !r.y.light)
+		return FColor::Black;
+
+	FColor f = Contribution(surface, r.y);
+	if (f.IsBlack() || Occluded(surface, r.y, scene, context))
+		return FColor::Black;
+
+	return surface.beta * f * r.W;
+}
+
+} // namespace pbrt
@@ -0,0 +1,133 @@
+// \brief
+//		ReSTIR direct lighting: resampled light samples reused across pixels and passes
+//
+
+#pragma once
+
+#include "integrator.h"
+
+
+namespace pbrt
+{
+
+// a point sampled on one light, kept by a reservoir and evaluated again at other shading points
+struct FLightVertex
+{
+	const FLight* light;
+	FPoint3		pos;		// finite lights
+	FNormal3	normal;		// area lights
+	FVector3	wi;			// lights at infinity
+
+	FLightVertex() : light(nullptr) {}
+};
+
+// weighted reservoir of one light vertex
+//   streams candidates and keeps each with probability weight / wSum. W is the unbiased contribution
+//   weight of the kept sample: f(y) * W estimates the integral of f when the samples were
+//   resampled by a target pdf phat that is nonzero wherever f is.
+// https://research.nvidia.com/publication/2020-07_spatiotemporal-reservoir-resampling-real-time-ray-tracing-dynamic-direct
+struct FReservoir
+{
+	FLightVertex y;
+	Float wSum;
+	Float M;		// candidates seen
+	Float W;
+
+	FReservoir() : wSum(0), M(0), W(0) {}
+
+	bool Update(const FLightVertex& x, Float weight, Float u)
+	{
+		wSum += weight;
+		M += 1;
+		if (weight > 0 && u * wSum < weight)
+		{
+			y = x;
+			return true;
+		}
+
+		return false;
+	}
+
+	// takes over the candidates of r, whose sample has target pdf pHat at this reservoir's pixel
+	void Merge(const FReservoir& r, Float pHat, Float u)
+	{
+		const Float M0 = M;
+		Update(r.y, pHat * r.W * r.M, u);
+		M = M0 + r.M;
+	}
+
+	void Finalize(Float pHat)
+	{
+		W = (pHat > 0 && M > 0) ? wSum / (M * pHat) : 0;
+	}
+};
+
+// ReSTIR integrator
+//   direct lighting only, perfectly specular surfaces are followed to the first rough one. every pass
+//   renders one sample of every pixel:
+//     1. candidates: candidatesNum light samples from the scene's light sampler are resampled into
+//        one, by the unshadowed contribution phat = f * Le * G. one shadow ray drops it if occluded.
+//     2. temporal reuse: merged with the pixel's reservoir of the previous pass.
+//     3. spatial reuse: merged with spatialNum random neighbors within spatialRadius pixels, weighted
+//        by the balance heuristic over their target pdfs.
+//     4. shading: one shadow ray for the kept sample, whose reservoir is the next pass's history.
+//   so a pixel pass costs two shadow rays however many lights and candidates there are. neighbors
+//   with different normals or depths are skipped, and merged samples are not tested for visibility
+//   at the new pixel (the biased variant of the paper), only by the shading ray: pixels next to
+//   shadow edges come out slightly dark.
+//   the reuse makes every pass much better than an independent one, for previews, but also makes the
+//   passes correlated. a converged render averages independent passes better, with reuse turned off.
+class FReSTIRIntegrator : public FIntegrator
+{
+public:
+	FReSTIRIntegrator(int maxDepth, int candidatesNum = 32, int spatialNum = 5, Float spatialRadius = 30, bool bTemporal = true)
+		: maxDepth(maxDepth)
+		, candidatesNum(candidatesNum)
+		, spatialNum(spatialNum)
+		, spatialRadius(spatialRadius)
+		, bTemporal(bTemporal)
+	{
+	}
+
+	// one pass over the image per sample of the sampler
+	void Render(const FScene* scene, FSampler* sampler, FFilm* film, bool bParallel = true) const override;
+
+	// the estimate of one pixel without reuse
+	FColor Li(const FRay& ray, const FScene* scene, FThreadContext& context) const override;
+
+protected:
+	// first rough surface seen through a pixel
+	struct FSurface
+	{
+		FIntersection isect;
+		const FBSDF* bsdf;		// nullptr if the path escaped
+		FColor beta;			// throughput of the specular bounces
+		Float depth;			// distance to the camera along the path
+
+		FSurface() : bsdf(nullptr), depth(0) {}
+	};
+
+	// traces the specular chain of ray, returns the emission it sees, the bsdf is in the context's arena
+	FColor TraceSurface(const FRay& ray, const FScene* scene, FThreadContext& context, FSurface& surface) const;
+
+	FReservoir SampleCandidates(const FSurface& surface, const FScene* scene, FThreadContext& context) const;
+
+	// unshadowed contribution of y at the surface, in the measure y was sampled in
+	FColor Contribution(const FSurface& surface, const FLightVertex& y) const;
+	Float TargetPdf(const FSurface& surface, const FLightVertex& y) const { return Contribution(surface, y).Luminance(); }
+
+	bool Occluded(const FSurface& surface, const FLightVertex& y, const FScene* scene, FThreadContext& context) const;
+	// whether samples of b are reused at a
+	bool Similar(const FSurface& a, const FSurface& b) const;
+
+	FColor Shade(const FSurface& surface, const FReservoir& r, const FScene* scene, FThreadContext& context) const;
+
+protected:
+	int maxDepth;
+	int candidatesNum;
+	int spatialNum;
+	Float spatialRadius;
+	bool bTemporal;
+};
+
+} // namespace pbrt
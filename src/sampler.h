@@ -6,51 +6,163 @@
 
 #include "pbrt.h"
 #include "geometry.h"
+#include "bluenoise.h"
 
 
 namespace pbrt
 {
 
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/util/hash.h
+inline uint64_t MixBits(uint64_t v)
+{
+	v ^= (v >> 31);
+	v *= 0x7fb5d329728ea185ull;
+	v ^= (v >> 27);
+	v *= 0x81dadef4bc2dd44dull;
+	v ^= (v >> 33);
+	return v;
+}
+
+inline uint64_t HashInts(uint64_t a, uint64_t b, uint64_t c)
+{
+	return MixBits(MixBits(MixBits(a) ^ b) ^ c);
+}
+
+inline uint32_t ReverseBits32(uint32_t v)
+{
+	v = (v << 16) | (v >> 16);
+	v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+	v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+	v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+	v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+	return v;
+}
+
+// element i of a random permutation of [0, n) selected by seed, without storing the permutation
+// https://graphics.pixar.com/library/MultiJitteredSampling/paper.pdf
+inline uint32_t PermutationElement(uint32_t i, uint32_t n, uint32_t seed)
+{
+	uint32_t w = n - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+
+	do
+	{
+		i ^= seed;
+		i *= 0xe170893d;
+		i ^= seed >> 16;
+		i ^= (i & w) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3f;
+		i ^= seed >> 23;
+		i ^= (i & w) >> 1;
+		i *= 1 | seed >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & w) >> 11;
+		i *= 0x74dcb303;
+		i ^= (i & w) >> 2;
+		i *= 0x9e501cc3;
+		i ^= (i & w) >> 2;
+		i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= n);
+
+	return (i + seed) % n;
+}
+
 // random number generator
-// https://github.com/SmallVCM/SmallVCM/blob/master/src/rng.hxx
+//   pcg32, 16 bytes of state. SetSequence selects one of 2^63 independent streams and Advance
+//   jumps along a stream in O(log n) steps, so any (pixel, sample, dimension) can be addressed directly.
+// https://www.pcg-random.org
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/util/rng.h
 class FRNG
 {
 public:
-	std::mt19937_64 rng_engine;
-
-	std::uniform_int_distribution<int> int_dist;
-	std::uniform_int_distribution<uint32_t> uint_dist;
-	std::uniform_real_distribution<Float> float_dist{ (Float)0, (Float)1 };
-
 	// constructor
-	FRNG(int seed = 1234)
-		: rng_engine(seed)
+	FRNG()
+		: state(0x853c49e6748fea9bull)
+		, inc(0xda3e39cb94b95bdbull)
 	{}
 
+	FRNG(uint64_t sequence)
+	{
+		SetSequence(sequence);
+	}
+
+	void SetSequence(uint64_t sequence, uint64_t offset)
+	{
+		state = 0u;
+		inc = (sequence << 1u) | 1u;
+		uniform_uint();
+		state += offset;
+		uniform_uint();
+	}
+
+	void SetSequence(uint64_t sequence)
+	{
+		SetSequence(sequence, MixBits(sequence));
+	}
+
+	// skip delta numbers
+	void Advance(uint64_t delta)
+	{
+		uint64_t curMult = MULT, curPlus = inc, accMult = 1u, accPlus = 0u;
+		while (delta > 0)
+		{
+			if (delta & 1)
+			{
+				accMult *= curMult;
+				accPlus = accPlus * curMult + curPlus;
+			}
+			curPlus = (curMult + 1) * curPlus;
+			curMult *= curMult;
+			delta /= 2;
+		}
+
+		state = accMult * state + accPlus;
+	}
+
 	// [0, int_max]
 	int uniform_int()
 	{
-		return int_dist(rng_engine);
+		return (int)(uniform_uint() >> 1);
 	}
 
 	// [0, uint_max]
 	uint32_t uniform_uint()
 	{
-		return uint_dist(rng_engine);
+		uint64_t oldstate = state;
+		state = oldstate * MULT + inc;
+		uint32_t xorshifted = (uint32_t)(((oldstate >> 18u) ^ oldstate) >> 27u);
+		uint32_t rot = (uint32_t)(oldstate >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
 	}
 
 	// [0, 1)
 	Float uniform_float()
 	{
-		return float_dist(rng_engine);
+		return std::min(OneMinusEpsilon, (Float)(uniform_uint() * 0x1p-32));
 	}
 
 	// [0, 1)  [0, 1)
 	FFloat2 uniform_float2()
 	{
-		return FFloat2(uniform_float(), uniform_float());
+		Float u = uniform_float();
+		return FFloat2(u, uniform_float());
 	}
 
+	// largest float below 1
+	static PBRT_CONSTEXPR Float OneMinusEpsilon = (Float)0x1.fffffep-1;
+
+protected:
+	static const uint64_t MULT = 0x5851f42d4c957f2dull;
+
+	uint64_t state;
+	uint64_t inc;
 };
 
 // camera sample
@@ -66,8 +178,14 @@ class FSampler
 public:
 	virtual ~FSampler() {}
 
-	FSampler(int samples_per_pixel)
+	FSampler(int samples_per_pixel, int seed = 0)
 		: samples_per_pixel(samples_per_pixel)
+		, seed(seed)
+		, pixelx(0)
+		, pixely(0)
+		, current_sample_index(0)
+		, array1DOffset(0)
+		, array2DOffset(0)
 	{}
 
 
@@ -83,25 +201,162 @@ public:
 		samples_per_pixel = samples;
 	}
 
-	virtual void StartPixel()
+	// the random numbers of a sample only depend on the pixel, the sample index and the seed,
+	// never on the thread or the tile order
+	virtual void StartPixel(int x, int y)
 	{
+		pixelx = x;
+		pixely = y;
 		current_sample_index = 0;
+		GenerateArrays(0, samples_per_pixel);
+		StartSample();
+	}
+
+	// starts sample index of pixel (x, y) directly, for integrators that visit the pixels once per
+	// sample in several passes over the image. only the arrays of this sample are generated
+	void StartPixelSample(int x, int y, int index)
+	{
+		pixelx = x;
+		pixely = y;
+		current_sample_index = index;
+		GenerateArrays(index, index + 1);
+		StartSample();
+	}
+
+	// sample arrays
+	//   an integrator that takes n samples at once (eg. n samples of one light) requests an array of n
+	//   values per sample before rendering, then gets it with the same n once per sample, in request
+	//   order. the arrays of a pixel are laid out for all its samples, so the sampler can distribute the
+	//   n values of one sample well and also the values of all samples.
+	//   requests are not cloned, make them on the sampler of every thread.
+	void Request1DArray(int n)
+	{
+		samples1DArraySizes.push_back(n);
+		samples1DArrays.emplace_back();
+	}
+
+	void Request2DArray(int n)
+	{
+		samples2DArraySizes.push_back(n);
+		samples2DArrays.emplace_back();
+	}
+
+	// the best array size at least n, integrators should request this size
+	virtual int RoundCount(int n) const { return n; }
+
+	// nullptr once all requested arrays of the sample are used
+	const Float* Get1DArray(int n)
+	{
+		if (array1DOffset == (int)samples1DArrays.size())
+			return nullptr;
+
+		PBRT_DOCHECK(samples1DArraySizes[array1DOffset] == n);
+		return &samples1DArrays[array1DOffset++][current_sample_index * n];
+	}
+
+	const FFloat2* Get2DArray(int n)
+	{
+		if (array2DOffset == (int)samples2DArrays.size())
+			return nullptr;
+
+		PBRT_DOCHECK(samples2DArraySizes[array2DOffset] == n);
+		return &samples2DArrays[array2DOffset++][current_sample_index * n];
 	}
 
 	virtual bool NextSample()
 	{
 		current_sample_index++;
-		return current_sample_index < samples_per_pixel;
+		if (current_sample_index < samples_per_pixel)
+		{
+			StartSample();
+			return true;
+		}
+
+		return false;
 	}
 
 	virtual Float GetFloat() = 0;
 	virtual FFloat2 GetFloat2() = 0;
 	virtual FCameraSample GetCameraSample(const FPoint2& posfilm) = 0;
 
+protected:
+	// one stream per pixel, 65536 dimensions per sample
+	virtual void StartSample()
+	{
+		rng.SetSequence(HashInts((uint64_t)pixelx, (uint64_t)pixely, (uint64_t)seed));
+		rng.Advance((uint64_t)current_sample_index * 65536ull);
+
+		array1DOffset = 0;
+		array2DOffset = 0;
+	}
+
+	// fills the requested arrays of the samples [first, last) of the pixel, independent random values
+	// by default. a sample gets the same values whatever range it is generated in
+	virtual void GenerateArrays(int first, int last)
+	{
+		if (samples1DArrays.empty() && samples2DArrays.empty())
+			return;
+
+		ResizeArrays();
+		for (int s = first; s < last; ++s)
+		{
+			FRNG arrayrng(ArraySequence(s));
+
+			for (size_t i = 0; i < samples1DArrays.size(); ++i)
+			{
+				const int count = samples1DArraySizes[i];
+				for (int j = 0; j < count; ++j)
+				{
+					samples1DArrays[i][s * count + j] = arrayrng.uniform_float();
+				}
+			} // end for i
+
+			for (size_t i = 0; i < samples2DArrays.size(); ++i)
+			{
+				const int count = samples2DArraySizes[i];
+				for (int j = 0; j < count; ++j)
+				{
+					samples2DArrays[i][s * count + j] = arrayrng.uniform_float2();
+				}
+			} // end for i
+		} // end for s
+	}
+
+	void ResizeArrays()
+	{
+		for (size_t i = 0; i < samples1DArrays.size(); ++i)
+		{
+			samples1DArrays[i].resize(samples1DArraySizes[i] * samples_per_pixel);
+		}
+
+		for (size_t i = 0; i < samples2DArrays.size(); ++i)
+		{
+			samples2DArrays[i].resize(samples2DArraySizes[i] * samples_per_pixel);
+		}
+	}
+
+	// stream of the arrays of sample s of the pixel, apart from the per sample ones
+	uint64_t ArraySequence(int s) const
+	{
+		return HashInts(HashInts((uint64_t)pixelx, (uint64_t)pixely, (uint64_t)seed), (uint64_t)s, 1);
+	}
+
 protected:
 	FRNG	rng;
 	int		samples_per_pixel;
+	int		seed;
+	int		pixelx;
+	int		pixely;
 	int		current_sample_index;
+
+	// requested sizes per sample, and the values of all samples of the pixel (samples x size)
+	std::vector<int> samples1DArraySizes;
+	std::vector<int> samples2DArraySizes;
+	std::vector<std::vector<Float>> samples1DArrays;
+	std::vector<std::vector<FFloat2>> samples2DArrays;
+
+	int		array1DOffset;
+	int		array2DOffset;
 };
 
 
@@ -113,7 +368,7 @@ public:
 
 	virtual std::unique_ptr<FSampler> Clone() override
 	{
-		return std::make_unique<FDebugSampler>(samples_per_pixel);
+		return std::make_unique<FDebugSampler>(samples_per_pixel, seed);
 	}
 
 	virtual Float GetFloat() override { return 0.5f; }
@@ -134,7 +389,7 @@ public:
 
 	virtual std::unique_ptr<FSampler> Clone() override
 	{
-		return std::make_unique<FRandomSampler>(samples_per_pixel);
+		return std::make_unique<FRandomSampler>(samples_per_pixel, seed);
 	}
 
 	virtual Float GetFloat() override { 
@@ -156,22 +411,43 @@ public:
 };
 
 // stratified sampler
-// TODO:
+//   the first dimensions of a pixel are precomputed in StartPixel: one jittered stratum per sample,
+//   the strata permuted per dimension so the dimensions are not correlated with each other. the stratum
+//   of a sample is its permuted index, so a sample can be generated alone. GetFloat and GetFloat2
+//   hand out the dimensions in call order (the camera sample is the first 2d one), dimensions past
+//   the arrays fall back to independent random numbers.
+// https://github.com/mmp/pbrt-v3/blob/master/src/samplers/stratified.cpp
 class FStratifiedSampler : public FSampler
 {
 public:
-	using FSampler::FSampler;
+	FStratifiedSampler(int samples_per_pixel, int seed = 0, int inDimensions = 8, bool bJitter = true)
+		: FSampler(samples_per_pixel, seed)
+		, dimensions(inDimensions)
+		, bJitter(bJitter)
+		, current1D(0)
+		, current2D(0)
+	{}
 
 	virtual std::unique_ptr<FSampler> Clone() override
 	{
-		return std::make_unique<FStratifiedSampler>(samples_per_pixel);
+		return std::make_unique<FStratifiedSampler>(samples_per_pixel, seed, dimensions, bJitter);
 	}
 
 	virtual Float GetFloat() override {
+		if (current1D < dimensions)
+		{
+			return samples1D[(current1D++) * samples_per_pixel + current_sample_index];
+		}
+
 		return rng.uniform_float();
 	}
 
 	virtual FFloat2 GetFloat2() override {
+		if (current2D < dimensions)
+		{
+			return samples2D[(current2D++) * samples_per_pixel + current_sample_index];
+		}
+
 		return rng.uniform_float2();
 	}
 
@@ -179,9 +455,330 @@ public:
 	{
 		FCameraSample sample;
 
-		sample.posfilm = posfilm + rng.uniform_float2();
+		sample.posfilm = posfilm + GetFloat2();
 		return sample;
 	}
+
+protected:
+	virtual void StartSample() override
+	{
+		FSampler::StartSample();
+
+		current1D = 0;
+		current2D = 0;
+	}
+
+	// the precomputed dimensions, then the requested arrays: every array of a sample is stratified
+	virtual void GenerateArrays(int first, int last) override
+	{
+		const int n = samples_per_pixel;
+		samples1D.resize(dimensions * n);
+		samples2D.resize(dimensions * n);
+		ResizeArrays();
+
+		const uint64_t pixelhash = HashInts((uint64_t)pixelx, (uint64_t)pixely, (uint64_t)seed);
+		for (int s = first; s < last; ++s)
+		{
+			FRNG arrayrng(ArraySequence(s));
+
+			for (int d = 0; d < dimensions; ++d)
+			{
+				const uint64_t hash = HashInts(pixelhash, (uint64_t)d, 0);
+				samples1D[d * n + s] = Jitter(PermutationElement((uint32_t)s, (uint32_t)n, (uint32_t)hash), n, arrayrng);
+				samples2D[d * n + s] = Stratum2D(PermutationElement((uint32_t)s, (uint32_t)n, (uint32_t)(hash >> 32)), n, (uint32_t)MixBits(hash), arrayrng);
+			} // end for d
+
+			for (size_t i = 0; i < samples1DArrays.size(); ++i)
+			{
+				const int count = samples1DArraySizes[i];
+				stratified_sample_1d(&samples1DArrays[i][s * count], count, arrayrng, bJitter);
+			} // end for i
+
+			for (size_t i = 0; i < samples2DArrays.size(); ++i)
+			{
+				const int count = samples2DArraySizes[i];
+				stratified_sample_2d(&samples2DArrays[i][s * count], count, arrayrng, bJitter);
+			} // end for i
+		} // end for s
+	}
+
+	// a point in stratum i of n strata of [0, 1)
+	Float Jitter(uint32_t i, int n, FRNG& rng) const
+	{
+		Float delta = bJitter ? rng.uniform_float() : (Float)0.5;
+		return std::min((i + delta) / n, FRNG::OneMinusEpsilon);
+	}
+
+	// cell i of a jittered grid when n is a square, otherwise latin hypercube: stratum i along x and
+	// the stratum of i permuted by yhash along y
+	FFloat2 Stratum2D(uint32_t i, int n, uint32_t yhash, FRNG& rng) const
+	{
+		const int nx = (int)std::sqrt((Float)n);
+		if (nx * nx == n)
+		{
+			Float x = Jitter(i % nx, nx, rng);
+			return FFloat2(x, Jitter(i / nx, nx, rng));
+		}
+
+		Float x = Jitter(i, n, rng);
+		return FFloat2(x, Jitter(PermutationElement(i, (uint32_t)n, yhash), n, rng));
+	}
+
+	// n strata of [0, 1)
+	static void stratified_sample_1d(Float* samples, int n, FRNG& rng, bool bJitter)
+	{
+		const Float invn = (Float)1 / n;
+		for (int i = 0; i < n; ++i)
+		{
+			Float delta = bJitter ? rng.uniform_float() : (Float)0.5;
+			samples[i] = std::min((i + delta) * invn, FRNG::OneMinusEpsilon);
+		}
+	}
+
+	// a jittered grid when n is a square, otherwise latin hypercube: n strata along each axis
+	static void stratified_sample_2d(FFloat2* samples, int n, FRNG& rng, bool bJitter)
+	{
+		const int nx = (int)std::sqrt((Float)n);
+		if (nx * nx == n)
+		{
+			const Float invn = (Float)1 / nx;
+			for (int y = 0; y < nx; ++y)
+			{
+				for (int x = 0; x < nx; ++x)
+				{
+					FFloat2 delta = bJitter ? rng.uniform_float2() : FFloat2((Float)0.5, (Float)0.5);
+					samples[y * nx + x] = FFloat2(std::min((x + delta.x) * invn, FRNG::OneMinusEpsilon),
+												  std::min((y + delta.y) * invn, FRNG::OneMinusEpsilon));
+				}
+			}
+			return;
+		}
+
+		const Float invn = (Float)1 / n;
+		for (int i = 0; i < n; ++i)
+		{
+			FFloat2 delta = bJitter ? rng.uniform_float2() : FFloat2((Float)0.5, (Float)0.5);
+			samples[i] = FFloat2(std::min((i + delta.x) * invn, FRNG::OneMinusEpsilon),
+								 std::min((i + delta.y) * invn, FRNG::OneMinusEpsilon));
+		}
+
+		// decouple the axes
+		for (int i = 0; i < n; ++i)
+		{
+			int other = i + (int)(rng.uniform_uint() % (uint32_t)(n - i));
+			std::swap(samples[i].y, samples[other].y);
+		}
+	}
+
+protected:
+	int dimensions;
+	bool bJitter;
+
+	// dimensions x samples
+	std::vector<Float> samples1D;
+	std::vector<FFloat2> samples2D;
+
+	int current1D;
+	int current2D;
+};
+
+// sobol sampler
+//   padded (0, 2)-sequence: every pair of dimensions takes the first two sobol dimensions, with the
+//   sample index permuted per (pixel, dimension) so the pairs are not correlated with each other and
+//   there is no limit on the path depth. each point is owen scrambled by a per (pixel, dimension) hash,
+//   which keeps the stratification and decorrelates the pixels. best with power of 2 sample counts.
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/samplers.h (PaddedSobolSampler)
+// https://psychopath.io/post/2021_01_30_building_a_better_lk_hash
+class FSobolSampler : public FSampler
+{
+public:
+	FSobolSampler(int samples_per_pixel, int seed = 0)
+		: FSampler(samples_per_pixel, seed)
+		, dimension(0)
+	{}
+
+	virtual std::unique_ptr<FSampler> Clone() override
+	{
+		return std::make_unique<FSobolSampler>(samples_per_pixel, seed);
+	}
+
+	virtual Float GetFloat() override {
+		uint64_t hash = DimensionHash();
+		uint32_t index = PermutationElement((uint32_t)current_sample_index, (uint32_t)samples_per_pixel, (uint32_t)hash);
+		dimension++;
+
+		return SampleDimension(0, index, (uint32_t)(hash >> 32));
+	}
+
+	virtual FFloat2 GetFloat2() override {
+		uint64_t hash = DimensionHash();
+		uint32_t index = PermutationElement((uint32_t)current_sample_index, (uint32_t)samples_per_pixel, (uint32_t)hash);
+		dimension += 2;
+
+		return FFloat2(SampleDimension(0, index, (uint32_t)hash), SampleDimension(1, index, (uint32_t)(hash >> 32)));
+	}
+
+	virtual FCameraSample GetCameraSample(const FPoint2& posfilm) override
+	{
+		FCameraSample sample;
+
+		sample.posfilm = posfilm + GetFloat2();
+		return sample;
+	}
+
+	// power of 2 arrays are nets
+	virtual int RoundCount(int n) const override
+	{
+		int count = 1;
+		while (count < n)
+		{
+			count *= 2;
+		}
+
+		return count;
+	}
+
+protected:
+	virtual void StartSample() override
+	{
+		dimension = 0;
+
+		array1DOffset = 0;
+		array2DOffset = 0;
+	}
+
+	// array i of sample s takes the points [s * n, (s + 1) * n) of one scrambled sobol sequence. with
+	// power of 2 sizes every array is a (0, m, 2)-net by itself, and all samples together are one too.
+	// the samples are shuffled so the arrays are not correlated with the other dimensions.
+	virtual void GenerateArrays(int first, int last) override
+	{
+		const int n = samples_per_pixel;
+
+		for (size_t i = 0; i < samples1DArrays.size(); ++i)
+		{
+			const uint64_t hash = HashInts((uint64_t)pixelx, (uint64_t)pixely, ((uint64_t)(i + 1) << 48) | (uint32_t)seed);
+			const int count = samples1DArraySizes[i];
+			samples1DArrays[i].resize(count * n);
+			for (int s = first; s < last; ++s)
+			{
+				uint32_t base = PermutationElement((uint32_t)s, (uint32_t)n, (uint32_t)hash) * (uint32_t)count;
+				for (int j = 0; j < count; ++j)
+				{
+					samples1DArrays[i][s * count + j] = SampleDimension(0, base + j, (uint32_t)(hash >> 32));
+				}
+			}
+		} // end for i
+
+		for (size_t i = 0; i < samples2DArrays.size(); ++i)
+		{
+			const uint64_t hash = HashInts((uint64_t)pixelx, (uint64_t)pixely, ((uint64_t)(i + 1) << 40) | (uint32_t)seed);
+			const uint64_t scramble = MixBits(hash);
+			const int count = samples2DArraySizes[i];
+			samples2DArrays[i].resize(count * n);
+			for (int s = first; s < last; ++s)
+			{
+				uint32_t base = PermutationElement((uint32_t)s, (uint32_t)n, (uint32_t)hash) * (uint32_t)count;
+				for (int j = 0; j < count; ++j)
+				{
+					samples2DArrays[i][s * count + j] = FFloat2(SampleDimension(0, base + j, (uint32_t)scramble),
+																SampleDimension(1, base + j, (uint32_t)(scramble >> 32)));
+				}
+			}
+		} // end for i
+	}
+
+	uint64_t DimensionHash() const
+	{
+		return HashInts((uint64_t)pixelx, (uint64_t)pixely, ((uint64_t)dimension << 32) | (uint32_t)seed);
+	}
+
+	// point index of sobol dimension 0 or 1, scrambled
+	static Float SampleDimension(int sobolDim, uint32_t index, uint32_t scramble)
+	{
+		uint32_t v = 0;
+		for (uint32_t column = 1u << 31; index != 0; index >>= 1)
+		{
+			if (index & 1)
+			{
+				v ^= column;
+			}
+
+			// generator matrix of dimension 0 is the identity (van der corput), of dimension 1 pascal's triangle
+			column = (sobolDim == 0) ? (column >> 1) : (column ^ (column >> 1));
+		}
+
+		return std::min((Float)(OwenScramble(v, scramble) * 0x1p-32), FRNG::OneMinusEpsilon);
+	}
+
+	// owen scrambling with a laine-karras style hash on the reversed bits: every bit is flipped
+	// depending on the bits above it only
+	static uint32_t OwenScramble(uint32_t v, uint32_t seed)
+	{
+		v = ReverseBits32(v);
+		v ^= v * 0x3d20adea;
+		v += seed;
+		v *= (seed >> 16) | 1;
+		v ^= v * 0x05526c56;
+		v ^= v * 0x53a22864;
+		return ReverseBits32(v);
+	}
+
+protected:
+	int dimension;
+};
+
+// blue noise sampler
+//   for previews at a few samples per pixel. every pixel uses the same padded sobol points (the
+//   shuffle and scramble only depend on the dimension), shifted toroidally by the value of a blue noise
+//   tile at the pixel, at a different tile offset per dimension. neighbour pixels get very different
+//   shifts, so their errors are spread as blue noise, which looks much smoother than the white noise
+//   of the other samplers at the same error.
+// https://www.arnoldrenderer.com/research/dither_abstract.pdf
+class FBlueNoiseSampler : public FSobolSampler
+{
+public:
+	using FSobolSampler::FSobolSampler;
+
+	virtual std::unique_ptr<FSampler> Clone() override
+	{
+		return std::make_unique<FBlueNoiseSampler>(samples_per_pixel, seed);
+	}
+
+	virtual Float GetFloat() override {
+		uint64_t hash = HashInts((uint64_t)dimension, (uint64_t)seed, 0);
+		uint32_t index = PermutationElement((uint32_t)current_sample_index, (uint32_t)samples_per_pixel, (uint32_t)hash);
+		Float u = Shift(SampleDimension(0, index, (uint32_t)(hash >> 32)), dimension);
+		dimension++;
+
+		return u;
+	}
+
+	virtual FFloat2 GetFloat2() override {
+		uint64_t hash = HashInts((uint64_t)dimension, (uint64_t)seed, 0);
+		uint32_t index = PermutationElement((uint32_t)current_sample_index, (uint32_t)samples_per_pixel, (uint32_t)hash);
+		FFloat2 u(Shift(SampleDimension(0, index, (uint32_t)hash), dimension),
+				  Shift(SampleDimension(1, index, (uint32_t)(hash >> 32)), dimension + 1));
+		dimension += 2;
+
+		return u;
+	}
+
+protected:
+	// u + blue noise of the pixel, wrapped to [0, 1)
+	Float Shift(Float u, int dim) const
+	{
+		const uint64_t offset = MixBits((uint64_t)dim + 1);
+		const int x = (pixelx + (int)(offset & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+		const int y = (pixely + (int)((offset >> 8) & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+
+		u += (BlueNoiseRanks[y * BLUE_NOISE_SIZE + x] + (Float)0.5) / (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE);
+		if (u >= 1)
+		{
+			u -= 1;
+		}
+
+		return std::min(u, FRNG::OneMinusEpsilon);
+	}
 };
 
 } // namespace pbrt
@@ -3,4 +3,472 @@
 //
 
 #include "sampling.h"
+#include "sampler.h"
 
+
+namespace pbrt
+{
+
+// density proportional to the line from a at x = 0 to b at x = 1
+static Float linear_sample(Float u, Float a, Float b)
+{
+	if (a + b == 0)
+		return u;
+	if (u == 0 && a == 0)
+		return 0;
+
+	Float x = u * (a + b) / (a + std::sqrt(Lerp(u, a * a, b * b)));
+	return std::min(x, FRNG::OneMinusEpsilon);
+}
+
+static Float invert_linear_sample(Float x, Float a, Float b)
+{
+	return (a + b == 0) ? x : x * (a * (2 - x) + b * x) / (a + b);
+}
+
+FPoint2 bilinear_sample(const FFloat2& uv, const Float w[4])
+{
+	// y by the marginal density, x by the line at that y
+	FPoint2 p;
+	p.y = linear_sample(uv.y, w[0] + w[1], w[2] + w[3]);
+	p.x = linear_sample(uv.x, Lerp(p.y, w[0], w[2]), Lerp(p.y, w[1], w[3]));
+
+	return p;
+}
+
+Float bilinear_pdf(const FPoint2& p, const Float w[4])
+{
+	if (p.x < 0 || p.x > 1 || p.y < 0 || p.y > 1)
+		return 0;
+
+	Float sum = w[0] + w[1] + w[2] + w[3];
+	if (sum == 0)
+		return 1;
+
+	return 4 * ((1 - p.x) * (1 - p.y) * w[0] + p.x * (1 - p.y) * w[1] + (1 - p.x) * p.y * w[2] + p.x * p.y * w[3]) / sum;
+}
+
+FFloat2 invert_bilinear_sample(const FPoint2& p, const Float w[4])
+{
+	return FFloat2(invert_linear_sample(p.x, Lerp(p.y, w[0], w[2]), Lerp(p.y, w[1], w[3])),
+				   invert_linear_sample(p.y, w[0] + w[1], w[2] + w[3]));
+}
+
+// angle between unit vectors, better than acos of the dot product close to 0 and pi
+static Float angle_between(const FVector3& v1, const FVector3& v2)
+{
+	if (Dot(v1, v2) < 0)
+		return kPi - 2 * std::asin(Clamp((v1 + v2).Length() / 2, -1, 1));
+
+	return 2 * std::asin(Clamp((v2 - v1).Length() / 2, -1, 1));
+}
+
+// v minus its projection on the unit vector w
+static FVector3 gram_schmidt(const FVector3& v, const FVector3& w)
+{
+	return v - Dot(v, w) * w;
+}
+
+Float spherical_triangle_area(const FPoint3 v[3], const FPoint3& p)
+{
+	FVector3 a = Normalize(v[0] - p), b = Normalize(v[1] - p), c = Normalize(v[2] - p);
+
+	// Van Oosterom and Strackee
+	return std::abs(2 * std::atan2(Dot(a, Cross(b, c)), 1 + Dot(a, b) + Dot(a, c) + Dot(b, c)));
+}
+
+/*
+	a, b, c: the triangle projected on the unit sphere around p
+
+	u[0] picks the sub triangle (a, b, c') with c' on the arc a-c, whose area is u[0] of the area,
+	u[1] the point on the arc b-c', uniform in the cosine to b
+
+	https://www.pbr-book.org/4ed/Shapes/Triangle_Meshes#SphericalTriangleSampling
+*/
+FVector3 spherical_triangle_sample(const FPoint3 v[3], const FPoint3& p, const FFloat2& uv, Float* pdf)
+{
+	*pdf = 0;
+
+	FVector3 a = Normalize(v[0] - p), b = Normalize(v[1] - p), c = Normalize(v[2] - p);
+
+	// normals of the planes through the edges
+	FVector3 n_ab = Cross(a, b), n_bc = Cross(b, c), n_ca = Cross(c, a);
+	if (n_ab.Length2() == 0 || n_bc.Length2() == 0 || n_ca.Length2() == 0)
+		return FVector3(1, 1, 1) / 3;
+
+	n_ab = Normalize(n_ab);
+	n_bc = Normalize(n_bc);
+	n_ca = Normalize(n_ca);
+
+	// angles at the vertices, the area is their sum minus pi
+	Float alpha = angle_between(n_ab, -n_ca);
+	Float beta = angle_between(n_bc, -n_ab);
+	Float gamma = angle_between(n_ca, -n_bc);
+
+	Float A_pi = alpha + beta + gamma;
+	Float Ap_pi = Lerp(uv.x, kPi, A_pi);
+	Float A = A_pi - kPi;
+	if (A <= 0)
+		return FVector3(1, 1, 1) / 3;
+	*pdf = 1 / A;
+
+	// cos of the arc a-c' giving the sub triangle area
+	Float cosAlpha = std::cos(alpha), sinAlpha = std::sin(alpha);
+	Float sinPhi = std::sin(Ap_pi) * cosAlpha - std::cos(Ap_pi) * sinAlpha;
+	Float cosPhi = std::cos(Ap_pi) * cosAlpha + std::sin(Ap_pi) * sinAlpha;
+	Float k1 = cosPhi + cosAlpha;
+	Float k2 = sinPhi - sinAlpha * Dot(a, b);
+	Float cosBp = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+	cosBp = Clamp(cosBp, -1, 1);
+
+	Float sinBp = std::sqrt(std::max((Float)0, 1 - cosBp * cosBp));
+	FVector3 cp = cosBp * a + sinBp * Normalize(gram_schmidt(c, a));
+
+	// point on the arc b-c'
+	Float cosTheta = 1 - uv.y * (1 - Dot(cp, b));
+	Float sinTheta = std::sqrt(std::max((Float)0, 1 - cosTheta * cosTheta));
+	FVector3 w = cosTheta * b + sinTheta * Normalize(gram_schmidt(cp, b));
+
+	// barycentrics of the ray p + t * w on the triangle
+	FVector3 e1 = v[1] - v[0], e2 = v[2] - v[0];
+	FVector3 s1 = Cross(w, e2);
+	Float divisor = Dot(s1, e1);
+	if (divisor == 0)
+		return FVector3(1, 1, 1) / 3;
+
+	Float invDivisor = 1 / divisor;
+	FVector3 s = p - v[0];
+	Float b1 = Clamp(Dot(s, s1) * invDivisor, 0, 1);
+	Float b2 = Clamp(Dot(w, Cross(s, e1)) * invDivisor, 0, 1);
+	if (b1 + b2 > 1)
+	{
+		Float sum = b1 + b2;
+		b1 /= sum;
+		b2 /= sum;
+	}
+
+	return FVector3(1 - b1 - b2, b1, b2);
+}
+
+FFloat2 invert_spherical_triangle_sample(const FPoint3 v[3], const FPoint3& p, const FVector3& w)
+{
+	FVector3 a = Normalize(v[0] - p), b = Normalize(v[1] - p), c = Normalize(v[2] - p);
+
+	FVector3 n_ab = Cross(a, b), n_bc = Cross(b, c), n_ca = Cross(c, a);
+	if (n_ab.Length2() == 0 || n_bc.Length2() == 0 || n_ca.Length2() == 0)
+		return FFloat2(0.5f, 0.5f);
+
+	n_ab = Normalize(n_ab);
+	n_bc = Normalize(n_bc);
+	n_ca = Normalize(n_ca);
+
+	Float alpha = angle_between(n_ab, -n_ca);
+	Float beta = angle_between(n_bc, -n_ab);
+	Float gamma = angle_between(n_ca, -n_bc);
+
+	// c' is where the arc from b through w meets the arc a-c
+	FVector3 cp = Normalize(Cross(Cross(b, w), Cross(c, a)));
+	if (Dot(cp, a + c) < 0)
+		cp = -cp;
+
+	// u[0] is the area of the sub triangle (a, b, c') over the area
+	Float u0 = 0;
+	if (Dot(a, cp) < (Float)0.99999847691 /* cos(0.1 deg) */)
+	{
+		FVector3 n_cpb = Cross(cp, b), n_acp = Cross(a, cp);
+		if (n_cpb.Length2() == 0 || n_acp.Length2() == 0)
+			return FFloat2(0.5f, 0.5f);
+
+		n_cpb = Normalize(n_cpb);
+		n_acp = Normalize(n_acp);
+		Float Ap = alpha + angle_between(n_ab, n_cpb) + angle_between(n_acp, -n_cpb) - kPi;
+		Float A = alpha + beta + gamma - kPi;
+		u0 = Ap / A;
+	}
+
+	Float u1 = (1 - Dot(w, b)) / (1 - Dot(cp, b));
+	return FFloat2(Clamp(u0, 0, 1), Clamp(u1, 0, 1));
+}
+
+// the rectangle in the frame of Urena et al.: p at the origin, the rectangle [x0, x1] x [y0, y1] on
+// the plane z = z0 <= 0
+struct FLocalRectangle
+{
+	FFrame frame;
+	Float x0, x1, y0, y1, z0;
+
+	FLocalRectangle(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey)
+	{
+		Float exl = ex.Length(), eyl = ey.Length();
+		frame = FFrame(ex / exl, ey / eyl, Cross(ex, ey));
+
+		FVector3 d = frame.ToLocal(s - p);
+		z0 = d.z;
+		if (z0 > 0)
+		{
+			frame.n = -frame.n;
+			z0 = -z0;
+		}
+
+		x0 = d.x;
+		y0 = d.y;
+		x1 = x0 + exl;
+		y1 = y0 + eyl;
+	}
+};
+
+// interior angles g of the spherical rectangle [x0, x1] x [y0, y1] at z0, and the z of the normals of the
+// planes through the edges at y0 (b0) and y1 (b1). returns the solid angle
+static Float spherical_rectangle_angles(Float x0, Float x1, Float y0, Float y1, Float z0, Float g[4], Float* b0, Float* b1)
+{
+	if (x1 <= x0 || y1 <= y0 || z0 == 0)
+		return 0;
+
+	FVector3 v00(x0, y0, z0), v01(x0, y1, z0);
+	FVector3 v10(x1, y0, z0), v11(x1, y1, z0);
+	FVector3 n0 = Normalize(Cross(v00, v10));
+	FVector3 n1 = Normalize(Cross(v10, v11));
+	FVector3 n2 = Normalize(Cross(v11, v01));
+	FVector3 n3 = Normalize(Cross(v01, v00));
+
+	g[0] = angle_between(-n0, n1);
+	g[1] = angle_between(-n1, n2);
+	g[2] = angle_between(-n2, n3);
+	g[3] = angle_between(-n3, n0);
+	*b0 = n0.z;
+	*b1 = n2.z;
+
+	return std::max((Float)0, g[0] + g[1] + g[2] + g[3] - 2 * kPi);
+}
+
+Float spherical_rectangle_area(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey)
+{
+	FLocalRectangle r(p, s, ex, ey);
+	Float g[4], b0, b1;
+
+	return spherical_rectangle_angles(r.x0, r.x1, r.y0, r.y1, r.z0, g, &b0, &b1);
+}
+
+FPoint3 spherical_rectangle_sample(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey, const FFloat2& uv, Float* pdf)
+{
+	FLocalRectangle r(p, s, ex, ey);
+	Float g[4], b0, b1;
+	Float area = spherical_rectangle_angles(r.x0, r.x1, r.y0, r.y1, r.z0, g, &b0, &b1);
+	if (area <= 0)
+	{
+		*pdf = 0;
+		return s + uv.x * ex + uv.y * ey;
+	}
+	*pdf = 1 / area;
+
+	// x of the sample, the sub rectangle [x0, xu] covers u[0] of the solid angle
+	Float au = uv.x * area - g[2] - g[3];
+	Float fu = (std::cos(au) * b0 - b1) / std::sin(au);
+	Float cu = std::copysign(1 / std::sqrt(fu * fu + b0 * b0), fu);
+	cu = Clamp(cu, -FRNG::OneMinusEpsilon, FRNG::OneMinusEpsilon);
+
+	Float xu = -(cu * r.z0) / std::sqrt(1 - cu * cu);
+	xu = Clamp(xu, r.x0, r.x1);
+
+	// y of the sample, uniform in the height of the direction along the segment at xu
+	Float dd = std::sqrt(xu * xu + r.z0 * r.z0);
+	Float h0 = r.y0 / std::sqrt(dd * dd + r.y0 * r.y0);
+	Float h1 = r.y1 / std::sqrt(dd * dd + r.y1 * r.y1);
+	Float hv = h0 + uv.y * (h1 - h0), hvsq = hv * hv;
+	Float yv = (hvsq < 1 - (Float)1e-6) ? (hv * dd) / std::sqrt(1 - hvsq) : r.y1;
+
+	return p + r.frame.ToWorld(FVector3(xu, yv, r.z0));
+}
+
+FFloat2 invert_spherical_rectangle_sample(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey, const FPoint3& q)
+{
+	FLocalRectangle r(p, s, ex, ey);
+	Float g[4], b0, b1;
+	Float area = spherical_rectangle_angles(r.x0, r.x1, r.y0, r.y1, r.z0, g, &b0, &b1);
+
+	FVector3 v = r.frame.ToLocal(q - p);
+	Float xu = Clamp(v.x, r.x0, r.x1), yv = Clamp(v.y, r.y0, r.y1);
+	if (area <= 0)
+		return FFloat2((xu - r.x0) / (r.x1 - r.x0), (yv - r.y0) / (r.y1 - r.y0));
+
+	// the part of the solid angle left of xu
+	Float u0 = spherical_rectangle_angles(r.x0, xu, r.y0, r.y1, r.z0, g, &b0, &b1) / area;
+
+	Float dd = std::sqrt(xu * xu + r.z0 * r.z0);
+	Float h0 = r.y0 / std::sqrt(dd * dd + r.y0 * r.y0);
+	Float h1 = r.y1 / std::sqrt(dd * dd + r.y1 * r.y1);
+	Float hv = yv / std::sqrt(dd * dd + yv * yv);
+	Float u1 = (h1 > h0) ? (hv - h0) / (h1 - h0) : 0;
+
+	return FFloat2(Clamp(u0, 0, 1), Clamp(u1, 0, 1));
+}
+
+FAliasTable::FAliasTable(const std::vector<Float>& weights)
+	: bins(weights.size())
+{
+	const int n = (int)weights.size();
+	if (n == 0)
+		return;
+
+	double sum = 0;
+	for (Float w : weights)
+	{
+		sum += w;
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		bins[i].p = sum > 0 ? (Float)(weights[i] / sum) : (Float)1 / n;
+		bins[i].alias = -1;
+	}
+
+	// split the bins into those under and over the average, then let every under bin take its
+	// missing probability from an over bin
+	struct FOutcome
+	{
+		double pHat;	// probability times n
+		int index;
+	};
+
+	std::vector<FOutcome> under, over;
+	for (int i = 0; i < n; ++i)
+	{
+		double pHat = (double)bins[i].p * n;
+		if (pHat < 1)
+			under.push_back({ pHat, i });
+		else
+			over.push_back({ pHat, i });
+	}
+
+	while (!under.empty() && !over.empty())
+	{
+		FOutcome un = under.back();
+		under.pop_back();
+		FOutcome ov = over.back();
+		over.pop_back();
+
+		bins[un.index].q = (Float)un.pHat;
+		bins[un.index].alias = ov.index;
+
+		double pExcess = un.pHat + ov.pHat - 1;
+		if (pExcess < 1)
+			under.push_back({ pExcess, ov.index });
+		else
+			over.push_back({ pExcess, ov.index });
+	} // end while
+
+	// the rest are 1 up to rounding
+	while (!over.empty())
+	{
+		bins[over.back().index].q = 1;
+		bins[over.back().index].alias = -1;
+		over.pop_back();
+	}
+
+	while (!under.empty())
+	{
+		bins[under.back().index].q = 1;
+		bins[under.back().index].alias = -1;
+		under.pop_back();
+	}
+}
+
+int FAliasTable::Sample(Float u, Float* pmf) const
+{
+	if (bins.empty())
+		return -1;
+
+	// the bin from the integer part of u * n, the choice within it from the fraction
+	const int n = (int)bins.size();
+	int offset = std::min((int)(u * n), n - 1);
+	Float up = u * n - offset;
+
+	int index = (up < bins[offset].q || bins[offset].alias < 0) ? offset : bins[offset].alias;
+	if (pmf)
+	{
+		*pmf = bins[index].p;
+	}
+
+	return index;
+}
+
+FDistribution1D::FDistribution1D(const Float* f, int n)
+	: func(f, f + n)
+	, cdf(n + 1)
+{
+	// integral of the step function up to each interval
+	cdf[0] = 0;
+	for (int i = 1; i < n + 1; ++i)
+	{
+		cdf[i] = cdf[i - 1] + std::abs(func[i - 1]) / n;
+	}
+
+	// a zero function is sampled uniformly
+	funcInt = cdf[n];
+	for (int i = 1; i < n + 1; ++i)
+	{
+		cdf[i] = funcInt == 0 ? (Float)i / n : cdf[i] / funcInt;
+	}
+}
+
+Float FDistribution1D::SampleContinuous(Float u, Float* pdf, int* offset) const
+{
+	// the last interval whose cdf is <= u
+	int index = (int)(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+	index = Clamp(index, 0, Count() - 1);
+	if (offset)
+	{
+		*offset = index;
+	}
+
+	Float du = u - cdf[index];
+	if (cdf[index + 1] - cdf[index] > 0)
+	{
+		du /= cdf[index + 1] - cdf[index];
+	}
+
+	if (pdf)
+	{
+		*pdf = funcInt > 0 ? func[index] / funcInt : 0;
+	}
+
+	return std::min((index + du) / Count(), FRNG::OneMinusEpsilon);
+}
+
+FDistribution2D::FDistribution2D(const Float* func, int nu, int nv)
+{
+	conditional.reserve(nv);
+	for (int v = 0; v < nv; ++v)
+	{
+		conditional.push_back(std::make_unique<FDistribution1D>(&func[v * nu], nu));
+	}
+
+	std::vector<Float> marginalFunc(nv);
+	for (int v = 0; v < nv; ++v)
+	{
+		marginalFunc[v] = conditional[v]->funcInt;
+	}
+
+	marginal = std::make_unique<FDistribution1D>(marginalFunc.data(), nv);
+}
+
+FPoint2 FDistribution2D::SampleContinuous(const FFloat2& u, Float* pdf) const
+{
+	Float pdfs[2];
+	int v;
+	Float d1 = marginal->SampleContinuous(u[1], &pdfs[1], &v);
+	Float d0 = conditional[v]->SampleContinuous(u[0], &pdfs[0]);
+
+	*pdf = pdfs[0] * pdfs[1];
+	return FPoint2(d0, d1);
+}
+
+Float FDistribution2D::Pdf(const FPoint2& p) const
+{
+	int iu = Clamp((int)(p[0] * conditional[0]->Count()), 0, conditional[0]->Count() - 1);
+	int iv = Clamp((int)(p[1] * marginal->Count()), 0, marginal->Count() - 1);
+
+	return marginal->funcInt > 0 ? conditional[iv]->func[iu] / marginal->funcInt : 0;
+}
+
+} // namespace pbrt
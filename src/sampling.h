@@ -125,6 +125,35 @@ inline FPoint2 uniform_triangle_sample(const FFloat2& uv)
 }
 
 
+// bilinear density on [0, 1)^2 with the weights w at the corners (0, 0), (1, 0), (0, 1), (1, 1)
+// https://www.pbr-book.org/4ed/Sampling_Algorithms/Sampling_Multidimensional_Functions
+FPoint2 bilinear_sample(const FFloat2& uv, const Float w[4]);
+Float bilinear_pdf(const FPoint2& p, const Float w[4]);
+// the uv bilinear_sample maps to p
+FFloat2 invert_bilinear_sample(const FPoint2& p, const Float w[4]);
+
+// solid angle of the triangle v seen from p
+Float spherical_triangle_area(const FPoint3 v[3], const FPoint3& p);
+
+// direction to the triangle v uniform in the solid angle it subtends at p, returns the barycentrics
+// of the point on the triangle. *pdf is 1 / solid angle, 0 if the triangle is degenerate seen from p
+// https://www.pbr-book.org/4ed/Shapes/Triangle_Meshes#SphericalTriangleSampling
+FVector3 spherical_triangle_sample(const FPoint3 v[3], const FPoint3& p, const FFloat2& uv, Float* pdf);
+// the uv spherical_triangle_sample maps to the direction w
+FFloat2 invert_spherical_triangle_sample(const FPoint3 v[3], const FPoint3& p, const FVector3& w);
+
+// solid angle of the rectangle s + [0, 1] ex + [0, 1] ey seen from p, ex and ey perpendicular
+Float spherical_rectangle_area(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey);
+
+// point on the rectangle uniform in the solid angle it subtends at p, *pdf is 1 / solid angle.
+//   u[0] moves along ex, u[1] along ey
+// https://www.pbr-book.org/4ed/Shapes/Bilinear_Patches#SamplingSphericalRectangles
+// An Area-Preserving Parametrization for Spherical Rectangles, Urena et al. 2013
+FPoint3 spherical_rectangle_sample(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey, const FFloat2& uv, Float* pdf);
+// the uv spherical_rectangle_sample maps to the point q of the rectangle
+FFloat2 invert_spherical_rectangle_sample(const FPoint3& p, const FPoint3& s, const FVector3& ex, const FVector3& ey, const FPoint3& q);
+
+
 inline Float balance_heuristic(int f_num, Float f_pdf, int g_num, Float g_pdf)
 {
 	return (f_num * f_pdf) / (f_num * f_pdf + g_num * g_pdf);
@@ -137,5 +166,74 @@ inline Float power_heuristic(int f_num, Float f_pdf, int g_num, Float g_pdf)
 }
 
 
+// alias table
+//   samples index i of n with probability weights[i] / sum(weights) in O(1): every bin holds the
+//   probability of its own index and the index of one other (the alias) filling it up to 1/n.
+//   all weights zero samples uniformly.
+// https://www.pbr-book.org/4ed/Sampling_Algorithms/The_Alias_Method
+class FAliasTable
+{
+public:
+	FAliasTable() {}
+	FAliasTable(const std::vector<Float>& weights);
+
+	// -1 if empty
+	int Sample(Float u, Float* pmf = nullptr) const;
+	Float PMF(int index) const { return bins[index].p; }
+	int Size() const { return (int)bins.size(); }
+
+protected:
+	struct FBin
+	{
+		Float q;		// probability of taking this bin's index, otherwise the alias
+		Float p;		// pmf of this bin's index
+		int	  alias;
+	};
+
+	std::vector<FBin> bins;
+};
+
+
+// piecewise constant 1D distribution on [0, 1)
+//   n equal intervals with density proportional to func, sampled by inverting the cdf. unlike the
+//   alias table the mapping from u is monotonic, so stratified u stay stratified.
+// https://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/Sampling_Random_Variables#Example:Piecewise-Constant1DFunctions
+class FDistribution1D
+{
+public:
+	FDistribution1D(const Float* f, int n);
+
+	int Count() const { return (int)func.size(); }
+	Float Integral() const { return funcInt; }
+
+	// x in [0, 1) with density *pdf, offset is the interval of x
+	Float SampleContinuous(Float u, Float* pdf, int* offset = nullptr) const;
+	Float DiscretePDF(int index) const { return funcInt > 0 ? func[index] / (funcInt * Count()) : 0; }
+
+protected:
+	std::vector<Float> func, cdf;
+	Float funcInt;
+
+	friend class FDistribution2D;
+};
+
+// piecewise constant 2D distribution on [0, 1)^2
+//   the marginal distribution picks v, the conditional distribution of that row picks u.
+// https://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/2D_Sampling_with_Multidimensional_Transformations#Piecewise-Constant2DDistributions
+class FDistribution2D
+{
+public:
+	// func is nv rows of nu values
+	FDistribution2D(const Float* func, int nu, int nv);
+
+	FPoint2 SampleContinuous(const FFloat2& u, Float* pdf) const;
+	Float Pdf(const FPoint2& p) const;
+
+protected:
+	std::vector<std::unique_ptr<FDistribution1D>> conditional;
+	std::unique_ptr<FDistribution1D> marginal;
+};
+
+
 } // namespace pbrt
 
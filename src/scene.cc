@@ -12,87 +12,207 @@ void FScene::Preprocess()
 {
 	CalculateWorldBound();
 
-	for (std::shared_ptr<FLight>& light : lights)
+	ParallelFor(0, shadow_lights.size(), 1, [this](int64_t i)
 	{
-		light->Preprocess(*this);
-	} // end for 
+		shadow_lights[i]->Preprocess(*this);
+	});
 
-	// build bvh
-	bvh = std::make_shared<FBVH_Node<FPrimitive*>>(shadow_primitives, 0, shadow_primitives.size());
+	if (lightSampling == LightSamplingBVH)
+	{
+		lightSampler = std::make_shared<FBVHLightSampler>(shadow_lights);
+	}
+	else
+	{
+		lightSampler = std::make_shared<FPowerLightSampler>(shadow_lights);
+	}
+	shadow_lightSampler = lightSampler.get();
+
+	lightSamplesNum = 1;
+	for (const FLight* light : shadow_lights)
+	{
+		lightSamplesNum = std::max(lightSamplesNum, light->SamplesNum());
+	}
+
+	// build bvh, the meshes first. their shapes are leaves of the scene bvh
+	for (FTriangleMesh* mesh : shadow_bvhMeshes)
+	{
+		mesh->BuildBVH(bvhLazyDepth, true);
+	}
+
+	bvh = std::make_shared<FBVH_Node<FPrimitive*>>(shadow_primitives, 0, shadow_primitives.size(), bvhLazyDepth);
 	shadow_bvh = bvh.get();
-}
 
-bool FScene::Intersect(const FRay& ray, FIntersection& oisect) const
-{
-	if (shadow_bvh)
+	bvhReplicas.clear();
+	shadow_bvhReplicas.clear();
+	for (FTriangleMesh* mesh : shadow_bvhMeshes)
 	{
-		return shadow_bvh->Intersect(ray, oisect);
+		mesh->SetReplicas({});
 	}
 
-	return false;
+	const bool bReplicate = bReplicateBVH && NumaNodesNum() > 1;
+	geometryCache->SetReplication(bReplicate);
+	if (bReplicate)
+	{
+		const int numnodes = NumaNodesNum();
+		bvhReplicas.resize(numnodes);
+		shadow_bvhReplicas.resize(numnodes);
+
+		// the leaves of the scene bvh are shared, each mesh is copied with its bvh and hot arrays
+		std::vector<std::vector<std::shared_ptr<FTriangleMesh>>> meshReplicas(shadow_bvhMeshes.size(), std::vector<std::shared_ptr<FTriangleMesh>>(numnodes));
+		for (int node = 0; node < numnodes; ++node)
+		{
+			RunOnNumaNode(node, [this, node, &meshReplicas]()
+			{
+				bvhReplicas[node] = bvh->Clone();
+
+				for (size_t i = 0; i < shadow_bvhMeshes.size(); ++i)
+				{
+					meshReplicas[i][node] = shadow_bvhMeshes[i]->CreateReplica(bvhLazyDepth);
+				}
+			});
+			shadow_bvhReplicas[node] = bvhReplicas[node].get();
+		} // end for node
+
+		for (size_t i = 0; i < shadow_bvhMeshes.size(); ++i)
+		{
+			shadow_bvhMeshes[i]->SetReplicas(meshReplicas[i]);
+		}
+
+		PBRT_PRINT("bvh replicated on %d numa nodes, %d meshes copied\n", numnodes, (int)shadow_bvhMeshes.size());
+	}
 }
 
-void FScene::CalculateWorldBound()
+bool FScene::Intersect(const FRay& ray, FIntersection& oisect, FThreadContext& context) const
 {
-	FBounds3 bound;
+	++context.stats.rays;
+	if (!Trace(ray, oisect, context))
+		return false;
 
-    for (auto primitive : primitives)
-	{
-        bound.Expand(primitive->WorldBounds());
-	}
+	oisect.ComputeShadingNormal();
+	return true;
+}
+
+bool FScene::Occluded(const FPoint3& pos, const FNormal3& normal, const FVector3& dir, Float dist, FThreadContext& context) const
+{
+	FRay ray(pos, dir, 0.001f, dist - 0.001f);
+	FIntersection unused;
 
-	worldBound = bound;
+	++context.stats.shadowRays;
+	return Trace(ray, unused, context);
+}
+
+bool FScene::Trace(const FRay& ray, FIntersection& oisect, FThreadContext& context) const
+{
+	const FBVH_NodeBase* root = shadow_bvhReplicas.empty() ? shadow_bvh : shadow_bvhReplicas[CurrentNumaNode()];
+	if (!root)
+		return false;
+
+	return root->Traverse(ray, oisect, context.traversalStack, context.stats.bvhNodes);
+}
+
+void FScene::CalculateWorldBound()
+{
+	worldBound = ParallelReduce(0, shadow_primitives.size(), 0, FBounds3(),
+		[this](int64_t start, int64_t end)
+		{
+			FBounds3 bound;
+			for (int64_t i = start; i < end; ++i)
+			{
+				bound.Expand(shadow_primitives[i]->WorldBounds());
+			}
+			return bound;
+		},
+		[](const FBounds3& a, const FBounds3& b) { return a.Join(b); });
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-std::vector<std::shared_ptr<FShape>> FScene::CreateTriangleMesh(const char* filename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
+FPrimitiveHandle FScene::CreatePrimitive(FShapeHandle inShape, FMaterialHandle inMaterial, FLightHandle inLight)
+{
+	if (inShape == InvalidHandle)
+		return InvalidHandle;
+
+	FPrimitiveHandle handle = primitives.Add(shadow_shapes[inShape], inMaterial, inLight);
+	shadow_primitives.push_back(&primitives[handle]);
+
+	return handle;
+}
+
+FShapeHandle FScene::CreateTriangleMesh(const char* filename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
+{
+	std::shared_ptr<FTriangleMesh> mesh;
+
+	if (!LoadTriangleMesh(filename, mesh, flip_normal, bFlipHandedness, offset, inScale, bMeshCleanup, meshCompression))
+		return InvalidHandle;
+
+	meshes.push_back(mesh);
+	shadow_bvhMeshes.push_back(mesh.get());
+
+	return CreateShape<FTriangleMeshShape>(mesh.get());
+}
+
+std::vector<FShapeHandle> FScene::CreateTriangles(const char* filename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
 {
-	std::vector<std::shared_ptr<FTriangle>> mesh;
-	std::vector<std::shared_ptr<FShape>> newshapes;
+	std::shared_ptr<FTriangleMesh> mesh;
+	std::vector<FShapeHandle> newshapes;
 
-	if (LoadTriangleMesh(filename, mesh, flip_normal, bFlipHandedness, offset, inScale))
+	if (LoadTriangleMesh(filename, mesh, flip_normal, bFlipHandedness, offset, inScale, bMeshCleanup, meshCompression))
 	{
-		for (auto triangle : mesh)
+		meshes.push_back(mesh);
+
+		newshapes.reserve(mesh->TriangleNum());
+		for (uint32_t i = 0; i < (uint32_t)mesh->TriangleNum(); ++i)
 		{
-			shapes.push_back(triangle);
-			newshapes.push_back(triangle);
-		} // end for 
+			newshapes.push_back(CreateShape<FTriangle>(mesh.get(), i));
+		} // end for i
 	}
 
 	return newshapes;
 }
 
-std::vector<std::shared_ptr<FPrimitive>> FScene::CreatePrimitives(const std::vector<std::shared_ptr<FShape>>& inMesh, const std::shared_ptr<FMaterial>& inMaterial)
+FShapeHandle FScene::CreateTriangleMeshProxy(const char* filename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
+{
+	return CreateShape<FTriangleMeshProxy>(geometryCache.get(), filename, flip_normal, bFlipHandedness, offset, inScale, bMeshCleanup, meshCompression);
+}
+
+FShapeHandle FScene::LoadTriangleMeshProxy(FTaskGraph& loader, const char* filename, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
+{
+	FTriangleMeshProxy* proxy = pools.Create<FTriangleMeshProxy>(geometryCache.get(), filename, flip_normal, bFlipHandedness, offset, inScale, bMeshCleanup, meshCompression, false);
+	proxy->Preload(loader);
+
+	return AddShape(proxy);
+}
+
+std::vector<FPrimitiveHandle> FScene::CreatePrimitives(const std::vector<FShapeHandle>& inMesh, FMaterialHandle inMaterial)
 {
-	std::vector<std::shared_ptr<FPrimitive>> newprimitives;
+	std::vector<FPrimitiveHandle> newprimitives;
+	newprimitives.reserve(inMesh.size());
 
-	for (auto triangle : inMesh)
+	for (FShapeHandle triangle : inMesh)
 	{
-		std::shared_ptr<FPrimitive> newprimitive = CreatePrimitive(triangle.get(), inMaterial.get(), nullptr);
-		newprimitives.push_back(newprimitive);
+		newprimitives.push_back(CreatePrimitive(triangle, inMaterial));
 	}
 
 	return newprimitives;
 }
 
-std::vector<std::shared_ptr<FAreaLight>> FScene::CreateAreaLights(int samplesNum, const FColor& radiance, const std::vector<std::shared_ptr<FShape>>& inShapes, const std::shared_ptr<FMaterial>& inMaterial)
+std::vector<FLightHandle> FScene::CreateAreaLights(int samplesNum, const FColor& radiance, const std::vector<FShapeHandle>& inShapes, FMaterialHandle inMaterial)
 {
-	std::vector<std::shared_ptr<FAreaLight>> newlights;
+	std::vector<FLightHandle> newlights;
 
-	for (auto shape : inShapes)
+	for (FShapeHandle shape : inShapes)
 	{
-		std::shared_ptr<FAreaLight> newlight = CreateAreaLight(samplesNum, radiance, shape, inMaterial);
+		newlights.push_back(CreateAreaLight(samplesNum, radiance, shape, inMaterial));
 	} // end for
 
 	return newlights;
 }
 
-std::shared_ptr<FAreaLight> FScene::CreateAreaLight(int samplesNum, const FColor& radiance, const std::shared_ptr<FShape>& inShape, const std::shared_ptr<FMaterial>& inMaterial)
+FLightHandle FScene::CreateAreaLight(int samplesNum, const FColor& radiance, FShapeHandle inShape, FMaterialHandle inMaterial)
 {
-	std::shared_ptr<FAreaLight> areaLight = CreateLight<FAreaLight>(FPoint3(0,0,0), samplesNum, radiance, inShape.get());
+	FLightHandle areaLight = CreateLight<FAreaLight>(FPoint3(0,0,0), samplesNum, radiance, shadow_shapes[inShape]);
 
-	CreatePrimitive(inShape.get(), inMaterial.get(), areaLight.get());
+	CreatePrimitive(inShape, inMaterial, areaLight);
 	return areaLight;
 }
 
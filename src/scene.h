@@ -12,6 +12,9 @@
 #include "primitive.h"
 #include "camera.h"
 #include "bvh.h"
+#include "proxy.h"
+#include "context.h"
+#include "lightsampler.h"
 
 
 namespace pbrt
@@ -26,29 +29,58 @@ public:
 		: name(inName)
 		, shadow_camera(nullptr)
 		, shadow_bvh(nullptr)
+		, bvhLazyDepth(-1)
+		, bReplicateBVH(false)
+		, lightSampling(LightSamplingBVH)
+		, areaLightSampling(ShapeSamplingCosine)
+		, shadow_lightSampler(nullptr)
+		, lightSamplesNum(1)
+		, bMeshCleanup(false)
+		, meshCompression(MeshCompressNone)
+		, geometryCache(std::make_shared<FGeometryCache>())
 	{}
 
 	const char* NameStr() const { return name.c_str(); }
 
-	void Preprocess();
-
-	bool Intersect(const FRay& ray, FIntersection& oisect) const;
-	bool Occluded(const FPoint3& pos, const FNormal3& normal, const FVector3& dir, Float dist) const
+	// weld, drop degenerates and reorder triangles of meshes created after this call
+	void SetMeshCleanup(bool bEnable) { bMeshCleanup = bEnable; }
+	// eMeshCompression flags for the storage of meshes created after this call
+	void SetMeshCompression(int flags) { meshCompression = flags; }
+	// how lights are picked for direct lighting, takes effect in Preprocess
+	void SetLightSampling(eLightSampling sampling) { lightSampling = sampling; }
+	// how area lights sample points on their shapes, takes effect in Preprocess
+	void SetAreaLightSampling(eShapeSampling sampling) { areaLightSampling = sampling; }
+	eShapeSampling AreaLightSampling() const { return areaLightSampling; }
+	// memory budget in bytes for the geometry of mesh proxies, 0 is unlimited
+	void SetGeometryMemoryBudget(size_t bytes) { geometryCache->SetMemoryBudget(bytes); }
+	const FGeometryCache* GeometryCache() const { return geometryCache.get(); }
+	// build only the top depth levels of the scene bvh and of each mesh bvh in Preprocess, deeper subtrees
+	// on first traversal. proxies loaded after this call build their mesh bvhs the same way. < 0 builds all
+	void SetLazyBVH(int depth)
 	{
-		FRay ray(pos, dir, 0.001f, dist - 0.001f);
-		FIntersection unused;
-
-		return Intersect(ray, unused);
+		bvhLazyDepth = depth;
+		geometryCache->SetBVHLazyDepth(depth);
 	}
+	// one copy of the bvh nodes, the triangle meshes and the proxy geometry per numa node, used by the
+	// workers pinned to that node. see SetParallelAffinity
+	void SetBVHReplication(bool bEnable) { bReplicateBVH = bEnable; }
+
+	void Preprocess();
+
+	// closest hit, counted in the stats of context
+	bool Intersect(const FRay& ray, FIntersection& oisect, FThreadContext& context) const;
+	bool Occluded(const FPoint3& pos, const FNormal3& normal, const FVector3& dir, Float dist, FThreadContext& context) const;
+	// called by a render thread after each tile, releases what its rays pinned. see FGeometryCache::FinishTile
+	void FinishTile() const { geometryCache->FinishTile(); }
 
-	bool Occluded(const FIntersection& isect1, const FPoint3& target) const
+	bool Occluded(const FIntersection& isect1, const FPoint3& target, FThreadContext& context) const
 	{
-		return Occluded(isect1.position, isect1.normal, Normalize(target - isect1.position), Distance(isect1.position, target));
+		return Occluded(isect1.position, isect1.normal, Normalize(target - isect1.position), Distance(isect1.position, target), context);
 	}
 
-	bool Occluded(const FIntersection& isect1, const FIntersection& isect2) const
+	bool Occluded(const FIntersection& isect1, const FIntersection& isect2, FThreadContext& context) const
 	{
-		return Occluded(isect1.position, isect1.normal, Normalize(isect2.position - isect1.position), Distance(isect1.position, isect2.position));
+		return Occluded(isect1.position, isect1.normal, Normalize(isect2.position - isect1.position), Distance(isect1.position, isect2.position), context);
 	}
 
 	FBounds3 WorldBound() const
@@ -60,6 +92,10 @@ public:
 	int LightNum() const { return (int)shadow_lights.size(); }
 	const std::vector<FLight*>& Lights() const { return shadow_lights; }
 	const std::vector<FLight*>& InfiniteLights() const { return shadow_infinitelights; }
+	// picks the light of a direct light estimate, built by Preprocess
+	const FLightSampler* LightSampler() const { return shadow_lightSampler; }
+	// estimates of the direct light at the first vertex of a path, the most any light asks for
+	int LightSamplesNum() const { return lightSamplesNum; }
 
 	//////////////////////////////////////////////////////////////////////////
 	// add interfaces
@@ -72,72 +108,79 @@ public:
 		return cam;
 	}
 
+	// shapes, materials and lights live in typed pools of the scene, primitives in one pool.
+	// they are addressed by 32 bit handles
 	template<typename T, typename ...U>
-	std::shared_ptr<T> CreateShape(const U& ... args)
+	FShapeHandle CreateShape(const U& ... args)
 	{
-		std::shared_ptr<T> shape = std::make_shared<T>(args...);
-
-		shapes.push_back(shape);
-		return shape;
+		return AddShape(pools.Create<T>(args...));
 	}
 
 	template<typename T, typename ...U>
-	std::shared_ptr<T> CreateMaterial(const U& ... args)
+	FMaterialHandle CreateMaterial(const U& ... args)
 	{
-		std::shared_ptr<T> mat = std::make_shared<T>(args...);
-
-		materials.push_back(mat);
-		return mat;
+		shadow_materials.push_back(pools.Create<T>(args...));
+		return (FMaterialHandle)(shadow_materials.size() - 1);
 	}
 
 	template<typename T, typename ...U>
-	std::shared_ptr<T> CreateLight(const U& ... args)
+	FLightHandle CreateLight(const U& ... args)
 	{
-		std::shared_ptr<T> light = std::make_shared<T>(args...);
+		T* light = pools.Create<T>(args...);
 
-		lights.push_back(light);
-		shadow_lights.push_back(light.get());
+		shadow_lights.push_back(light);
 
 		if (light->Flags() & eLightFlags::InfiniteLight)
 		{
-			shadow_infinitelights.push_back(light.get());
+			shadow_infinitelights.push_back(light);
 		}
 
-		return light;
+		return (FLightHandle)(shadow_lights.size() - 1);
 	}
 
-	template<typename ...U>
-	std::shared_ptr<FPrimitive> CreatePrimitive(const U& ... args)
-	{
-		std::shared_ptr<FPrimitive> primitive = std::make_shared<FPrimitive>(args...);
+	FPrimitiveHandle CreatePrimitive(FShapeHandle inShape, FMaterialHandle inMaterial, FLightHandle inLight = InvalidHandle);
 
-		primitives.push_back(primitive);
-		shadow_primitives.push_back(primitive.get());
-
-		return primitive;
-	}
+	// the whole mesh as one shape with a bvh of its own, built by Preprocess. InvalidHandle if loading failed
+	FShapeHandle CreateTriangleMesh(const char* filename, bool flip_normal = false, bool bFlipHandedness = false, const FVector3 & offset = FVector3(0, 0, 0), Float inScale = 1.f);
+	// one shape per triangle, for area lights
+	std::vector<FShapeHandle> CreateTriangles(const char* filename, bool flip_normal = false, bool bFlipHandedness = false, const FVector3& offset = FVector3(0, 0, 0), Float inScale = 1.f);
+	// the mesh is loaded when a ray first enters its bounding box, see FTriangleMeshProxy
+	FShapeHandle CreateTriangleMeshProxy(const char* filename, bool flip_normal = false, bool bFlipHandedness = false, const FVector3& offset = FVector3(0, 0, 0), Float inScale = 1.f);
+	// the mesh is loaded and its bvh built by nodes of loader, wait for it before Preprocess
+	FShapeHandle LoadTriangleMeshProxy(FTaskGraph& loader, const char* filename, bool flip_normal = false, bool bFlipHandedness = false, const FVector3& offset = FVector3(0, 0, 0), Float inScale = 1.f);
+	std::vector<FPrimitiveHandle> CreatePrimitives(const std::vector<FShapeHandle> &inMesh, FMaterialHandle inMaterial);
 
-	std::vector<std::shared_ptr<FShape>> CreateTriangleMesh(const char* filename, bool flip_normal = false, bool bFlipHandedness = false, const FVector3 & offset = FVector3(0, 0, 0), Float inScale = 1.f);
-	std::vector<std::shared_ptr<FPrimitive>> CreatePrimitives(const std::vector<std::shared_ptr<FShape>> &inMesh, const std::shared_ptr<FMaterial>& inMaterial);
+	std::vector<FLightHandle> CreateAreaLights(int samplesNum, const FColor& radiance, const std::vector<FShapeHandle> & inShapes, FMaterialHandle inMaterial);
+	FLightHandle CreateAreaLight(int samplesNum, const FColor& radiance, FShapeHandle inShape, FMaterialHandle inMaterial);
 
-	std::vector<std::shared_ptr<FAreaLight>> CreateAreaLights(int samplesNum, const FColor& radiance, const std::vector<std::shared_ptr<FShape>> & inShapes, const std::shared_ptr<FMaterial>& inMaterial);
-	std::shared_ptr<FAreaLight> CreateAreaLight(int samplesNum, const FColor& radiance, const std::shared_ptr<FShape> &inShape, const std::shared_ptr<FMaterial>& inMaterial);
+	const FShape* Shape(FShapeHandle handle) const { return shadow_shapes[handle]; }
+	const FMaterial* Material(FMaterialHandle handle) const { return shadow_materials[handle]; }
+	const FLight* Light(FLightHandle handle) const { return shadow_lights[handle]; }
+	const FAreaLight* AreaLight(FLightHandle handle) const { return static_cast<const FAreaLight*>(shadow_lights[handle]); }
+	const FPrimitive& Primitive(FPrimitiveHandle handle) const { return primitives[handle]; }
 
 protected:
 	void CalculateWorldBound();
+	bool Trace(const FRay& ray, FIntersection& oisect, FThreadContext& context) const;
+
+	FShapeHandle AddShape(FShape* shape)
+	{
+		shadow_shapes.push_back(shape);
+		return (FShapeHandle)(shadow_shapes.size() - 1);
+	}
 
 public:
 	std::string  name;
 	std::shared_ptr<FCamera>	camera;
-	std::vector<std::shared_ptr<FShape>>	shapes;
-	std::vector<std::shared_ptr<FMaterial>> materials;
-
-	std::vector<std::shared_ptr<FLight>> lights;
-
-	std::vector<std::shared_ptr<FPrimitive>> primitives;
+	std::vector<std::shared_ptr<FTriangleMesh>> meshes;
+	// meshes of FTriangleMeshShapes, their bvhs are built by Preprocess
+	std::vector<FTriangleMesh*> shadow_bvhMeshes;
 
 	// shadows for multi-thread visiting
 	FCamera* shadow_camera;
+	// handle tables into the pools
+	std::vector<FShape*> shadow_shapes;
+	std::vector<FMaterial*> shadow_materials;
 	std::vector<FLight*> shadow_lights;
 	std::vector<FLight*> shadow_infinitelights;
 	std::vector<FPrimitive*> shadow_primitives;
@@ -147,6 +190,26 @@ public:
 	// bvh 
 	std::shared_ptr<FBVH_NodeBase>  bvh;
 	FBVH_NodeBase* shadow_bvh;
+	int bvhLazyDepth;
+
+	bool bReplicateBVH;
+	std::vector<std::shared_ptr<FBVH_NodeBase>> bvhReplicas;
+	std::vector<FBVH_NodeBase*> shadow_bvhReplicas;
+
+	eLightSampling lightSampling;
+	eShapeSampling areaLightSampling;
+	std::shared_ptr<FLightSampler> lightSampler;
+	FLightSampler* shadow_lightSampler;
+	int lightSamplesNum;
+
+	bool bMeshCleanup;
+	int  meshCompression;
+
+	std::shared_ptr<FGeometryCache> geometryCache;
+
+	// declared last, the pooled objects go first
+	FPoolSet pools;
+	TPool<FPrimitive> primitives;
 };
 
 
@@ -4,25 +4,418 @@
 
 #include "shape.h"
 #include "primitive.h"
+#include "parallel.h"
 #include "../external/obj_loader.h"
+#include <unordered_map>
+#include <cstring>
 
 
 namespace pbrt
 {
-	std::unique_ptr<FBSDF> FIntersection::Bsdf(FSampler *sampler) const
+	void FIntersection::ComputeShadingNormal()
 	{
-		return primitive ? primitive->GetBsdf(*this, sampler) : nullptr;
+		if (mesh)
+		{
+			shadingNormal = mesh->ShadingNormal(triangle, position, normal);
+			mesh = nullptr;
+		}
+	}
+
+	FBSDF* FIntersection::Bsdf(const FScene& scene, FSampler *sampler, FMemoryArena& arena) const
+	{
+		return primitive ? primitive->GetBsdf(scene, *this, sampler, arena) : nullptr;
+	}
+
+	FColor FIntersection::Le(const FScene& scene) const
+	{
+		return primitive ? primitive->GetLe(scene, *this) : FColor::Black;
+	}
+
+	const FAreaLight* FIntersection::AreaLight(const FScene& scene) const
+	{
+		return primitive ? primitive->GetAreaLight(scene) : nullptr;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// triangle mesh
+
+	void FTriangleMesh::Build(const std::vector<FPoint3>& positions, const std::vector<FPoint2>& inUVs, const std::vector<FNormal3>& inNormals,
+		const std::vector<uint32_t>& inIndices, bool flip_normal, int inCompression)
+	{
+		compression = inCompression;
+		bFlipNormal = flip_normal;
+		indices = inIndices;
+
+		hot.clear();
+		quantized.clear();
+		uvs.clear();
+		normals.clear();
+		packedUVs.clear();
+		packedNormals.clear();
+
+		// cold
+		if (compression & MeshCompressAttributes)
+		{
+			packedUVs.resize(inUVs.size());
+			ParallelFor(0, inUVs.size(), 0, [&](int64_t i)
+			{
+				packedUVs[i] = (uint32_t)FloatToHalf(inUVs[i].x) | ((uint32_t)FloatToHalf(inUVs[i].y) << 16);
+			});
+
+			packedNormals.resize(inNormals.size());
+			ParallelFor(0, inNormals.size(), 0, [&](int64_t i)
+			{
+				packedNormals[i] = EncodeOctahedral(inNormals[i]);
+			});
+		}
+		else
+		{
+			uvs = inUVs;
+			normals = inNormals;
+		}
+
+		// hot
+		const size_t triangle_num = TriangleNum();
+		if (compression & MeshCompressPositions)
+		{
+			FBounds3 bounds;
+			for (const FPoint3& p : positions)
+			{
+				bounds.Expand(p);
+			}
+
+			const FVector3 extent = bounds._max - bounds._min;
+			quantizeOrigin = bounds._min;
+			quantizeScale = extent / 65535;
+
+			quantized.resize(triangle_num);
+			ParallelFor(0, triangle_num, 0, [&](int64_t t)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const FPoint3& p = positions[indices[t * 3 + k]];
+					for (int a = 0; a < 3; ++a)
+					{
+						long q = extent[a] > 0 ? std::lround((p[a] - quantizeOrigin[a]) / quantizeScale[a]) : 0;
+						quantized[t].p[k * 3 + a] = (uint16_t)Clamp(q, 0, 65535);
+					}
+				}
+			});
+		}
+		else
+		{
+			hot.resize(triangle_num);
+			ParallelFor(0, triangle_num, 0, [&](int64_t t)
+			{
+				FHotTriangle& tri = hot[t];
+				tri.p0 = positions[indices[t * 3 + 0]];
+				tri.p1 = positions[indices[t * 3 + 1]];
+				tri.p2 = positions[indices[t * 3 + 2]];
+				tri.normal = FaceNormal(Cross(tri.p1 - tri.p0, tri.p2 - tri.p0));
+			});
+		}
+
+		// the same box the root of the bvh gets
+		bounds = ParallelReduce(0, triangle_num, 0, FBounds3(),
+			[this](int64_t start, int64_t end)
+			{
+				FBounds3 bound;
+				for (int64_t t = start; t < end; ++t)
+				{
+					bound.Expand(TriangleBounds((uint32_t)t));
+				}
+				return bound;
+			},
+			[](const FBounds3& a, const FBounds3& b) { return a.Join(b); });
+	}
+
+	// nodes and leaves FBVH_Node builds for n objects, each leaf sits under a node of its own
+	static void CountBVHNodes(size_t n, size_t& nodes, size_t& leaves)
+	{
+		++nodes;
+		if (n <= MAX_HITTABLES_IN_LEAF)
+		{
+			++leaves;
+			return;
+		}
+
+		CountBVHNodes(n / 2, nodes, leaves);
+		CountBVHNodes(n - n / 2, nodes, leaves);
 	}
 
-	FColor FIntersection::Le() const
+	void FTriangleMesh::BuildBVH(int lazyDepth, bool bParallel)
 	{
-		return primitive ? primitive->GetLe(*this) : FColor::Black;
+		const size_t triangle_num = TriangleNum();
+		if (triangle_num == 0)
+			return;
+
+		// the leaves copy the indices, the lazy nodes point at the records
+		std::vector<FMeshTriangle> triangles(triangle_num);
+		std::vector<FMeshTriangle*> objects(triangle_num);
+		auto fill = [&](int64_t t)
+		{
+			triangles[t].bounds = TriangleBounds((uint32_t)t);
+			triangles[t].mesh = this;
+			triangles[t].index = (uint32_t)t;
+			objects[t] = &triangles[t];
+		};
+
+		if (bParallel)
+		{
+			ParallelFor(0, triangle_num, 0, fill);
+		}
+		else
+		{
+			for (size_t t = 0; t < triangle_num; ++t)
+			{
+				fill(t);
+			}
+		}
+
+		bvh = std::make_shared<FBVH_Node<FMeshTriangle*>>(objects, 0, triangle_num, lazyDepth, 0, bParallel);
+		shadow_bvh = bvh.get();
+		bvhBytes = BVHMemorySize(triangle_num);
+
+		if (lazyDepth >= 0)
+		{
+			bvhTriangles.swap(triangles);
+			bvhBytes += bvhTriangles.size() * sizeof(FMeshTriangle);
+		}
+	}
+
+	std::shared_ptr<FTriangleMesh> FTriangleMesh::CreateReplica(int lazyDepth) const
+	{
+		std::shared_ptr<FTriangleMesh> replica = std::make_shared<FTriangleMesh>();
+		replica->compression = compression;
+		replica->bFlipNormal = bFlipNormal;
+		replica->hot = hot;
+		replica->quantized = quantized;
+		replica->quantizeOrigin = quantizeOrigin;
+		replica->quantizeScale = quantizeScale;
+		replica->indices = indices;
+		replica->uvs = uvs;
+		replica->normals = normals;
+		replica->packedUVs = packedUVs;
+		replica->packedNormals = packedNormals;
+		replica->bounds = bounds;
+
+		// the leaves of the new bvh index the copied arrays
+		replica->BuildBVH(lazyDepth, false);
+		return replica;
+	}
+
+	void FTriangleMesh::SetReplicas(const std::vector<std::shared_ptr<FTriangleMesh>>& inReplicas)
+	{
+		replicas = inReplicas;
+
+		shadow_replicas.clear();
+		for (const auto& replica : replicas)
+		{
+			shadow_replicas.push_back(replica.get());
+		}
+	}
+
+	size_t FTriangleMesh::BVHMemorySize(size_t triangle_num)
+	{
+		if (triangle_num == 0)
+			return 0;
+
+		size_t nodes = 0, leaves = 0;
+		CountBVHNodes(triangle_num, nodes, leaves);
+
+		// make_shared puts a control block of two pointers in front of every node
+		return nodes * (sizeof(FBVH_Node<FMeshTriangle*>) + 2 * sizeof(void*))
+			+ leaves * (sizeof(FBVH_NodeLeaf<FMeshTriangle*>) + 2 * sizeof(void*));
+	}
+
+	FLightIntersection FTriangleMeshShape::SamplePosition(const FFloat2&, Float* out_pdf) const
+	{
+		PBRT_ERROR("FTriangleMeshShape can not be sampled as a light, use FScene::CreateTriangles\n");
+
+		*out_pdf = 0;
+		return FLightIntersection();
+	}
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// mesh cleanup
+
+	// indexed triangle soup, 3 indices per triangle
+	struct FIndexedMesh
+	{
+		std::vector<FPoint3> positions;
+		std::vector<FPoint2> uvs;
+		std::vector<FNormal3> normals;
+		std::vector<uint32_t> indices;
+
+		size_t TriangleNum() const { return indices.size() / 3; }
+	};
+
+	// vertices are duplicated only if all attributes are bitwise equal, so seams are kept.
+	struct FVertexKey
+	{
+		FPoint3 position;
+		FPoint2 uv;
+		FNormal3 normal;
+
+		bool operator==(const FVertexKey& other) const
+		{
+			return std::memcmp(this, &other, sizeof(FVertexKey)) == 0;
+		}
+	};
+
+	struct FVertexKeyHash
+	{
+		size_t operator()(const FVertexKey& key) const
+		{
+			// FNV-1a over the raw bytes
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&key);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(FVertexKey); ++i)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return (size_t)hash;
+		}
+	};
+
+	// merge duplicate vertices, return the number of vertices removed
+	static size_t WeldVertices(FIndexedMesh& mesh)
+	{
+		std::unordered_map<FVertexKey, uint32_t, FVertexKeyHash> unique_vertices;
+		std::vector<FPoint3> positions;
+		std::vector<FPoint2> uvs;
+		std::vector<FNormal3> normals;
+
+		unique_vertices.reserve(mesh.positions.size());
+		for (uint32_t& index : mesh.indices)
+		{
+			// value-initialized, the padding bytes are hashed and compared too
+			FVertexKey key{};
+			key.position = mesh.positions[index];
+			key.uv = mesh.uvs[index];
+			key.normal = mesh.normals[index];
+
+			auto it = unique_vertices.find(key);
+			if (it == unique_vertices.end())
+			{
+				it = unique_vertices.emplace(key, (uint32_t)positions.size()).first;
+				positions.push_back(key.position);
+				uvs.push_back(key.uv);
+				normals.push_back(key.normal);
+			}
+
+			index = it->second;
+		} // end for index
+
+		size_t removed = mesh.positions.size() - positions.size();
+		mesh.positions.swap(positions);
+		mesh.uvs.swap(uvs);
+		mesh.normals.swap(normals);
+
+		return removed;
+	}
+
+	// drop zero-area triangles, which would produce NaN normals. return the number of triangles removed
+	static size_t RemoveDegenerateTriangles(FIndexedMesh& mesh)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			uint32_t i0 = mesh.indices[i + 0], i1 = mesh.indices[i + 1], i2 = mesh.indices[i + 2];
+			if (i0 == i1 || i1 == i2 || i2 == i0)
+				continue;
+
+			const FPoint3& p0 = mesh.positions[i0];
+			FVector3 n = Cross(mesh.positions[i1] - p0, mesh.positions[i2] - p0);
+			Float length = n.Length();
+			if (!(length > 0) || !(n / length).IsValid())
+				continue;
+
+			mesh.indices[count++] = i0;
+			mesh.indices[count++] = i1;
+			mesh.indices[count++] = i2;
+		} // end for i
+
+		size_t removed = mesh.TriangleNum() - count / 3;
+		mesh.indices.resize(count);
+
+		return removed;
+	}
+
+	// spread the lower 10 bits of x out to every third bit
+	static inline uint32_t LeftShift3(uint32_t x)
+	{
+		x = (x | (x << 16)) & 0x030000FF;
+		x = (x | (x << 8)) & 0x0300F00F;
+		x = (x | (x << 4)) & 0x030C30C3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	// sort triangles by the morton code of their centroid, so neighbours in space are neighbours in memory
+	static void ReorderTriangles(FIndexedMesh& mesh)
+	{
+		FBounds3 bounds;
+		for (const FPoint3& p : mesh.positions)
+		{
+			bounds.Expand(p);
+		}
+
+		const FVector3 extent = bounds._max - bounds._min;
+		const size_t triangle_num = mesh.TriangleNum();
+		std::vector<std::pair<uint32_t, uint32_t>> codes(triangle_num);
+
+		for (size_t t = 0; t < triangle_num; ++t)
+		{
+			FPoint3 centroid = (mesh.positions[mesh.indices[t * 3 + 0]] + mesh.positions[mesh.indices[t * 3 + 1]] + mesh.positions[mesh.indices[t * 3 + 2]]) / 3;
+
+			uint32_t code = 0;
+			for (int a = 0; a < 3; ++a)
+			{
+				Float offset = extent[a] > 0 ? (centroid[a] - bounds._min[a]) / extent[a] : (Float)0;
+				uint32_t q = (uint32_t)Clamp(offset * 1024, 0, 1023);
+				code |= LeftShift3(q) << a;
+			}
+
+			codes[t] = std::make_pair(code, (uint32_t)t);
+		} // end for t
+
+		std::sort(codes.begin(), codes.end());
+
+		std::vector<uint32_t> indices(mesh.indices.size());
+		for (size_t t = 0; t < triangle_num; ++t)
+		{
+			uint32_t src = codes[t].second;
+			indices[t * 3 + 0] = mesh.indices[src * 3 + 0];
+			indices[t * 3 + 1] = mesh.indices[src * 3 + 1];
+			indices[t * 3 + 2] = mesh.indices[src * 3 + 2];
+		}
+		mesh.indices.swap(indices);
+	}
+
+	static void CleanupTriangleMesh(const char* filename, FIndexedMesh& mesh)
+	{
+		const size_t vertex_num = mesh.positions.size();
+		const size_t triangle_num = mesh.TriangleNum();
+
+		size_t welded = WeldVertices(mesh);
+		size_t removed = RemoveDegenerateTriangles(mesh);
+		ReorderTriangles(mesh);
+
+		// the triangles copy their vertices, so only the removed triangles save memory
+		const size_t triangle_bytes = sizeof(FTriangleMesh::FHotTriangle) + 3 * sizeof(uint32_t);
+
+		PBRT_PRINT("mesh cleanup %s: triangles %d -> %d (%d degenerate removed, %.2f KB), vertices %d -> %d\n",
+			filename, (int)triangle_num, (int)mesh.TriangleNum(), (int)removed, removed * triangle_bytes / 1024.0,
+			(int)vertex_num, (int)(vertex_num - welded));
 	}
 
 	// load triangles from *.obj file
-	bool LoadTriangleMesh(const char* filename, std::vector<std::shared_ptr<FTriangle>>& outTriangles, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale)
+	bool LoadTriangleMesh(const char* filename, std::shared_ptr<FTriangleMesh>& outMesh, bool flip_normal, bool bFlipHandedness, const FVector3& offset, Float inScale, bool bCleanup, int compression)
 	{
-		outTriangles.clear();
+		outMesh = nullptr;
 
 		objl::Loader loader;
 		if (!loader.LoadFile(filename))
@@ -34,36 +427,95 @@ namespace pbrt
 		PBRT_DOCHECK(loader.LoadedMeshes.size() == 1);
 		auto mesh = loader.LoadedMeshes[0];
 
-		outTriangles.reserve(mesh.Vertices.size() / 3);
-		for (int i = 0; i < mesh.Vertices.size(); i += 3)
+		FIndexedMesh indexed;
+		indexed.positions.reserve(mesh.Vertices.size());
+		indexed.uvs.reserve(mesh.Vertices.size());
+		indexed.normals.reserve(mesh.Vertices.size());
+		indexed.indices.reserve(mesh.Vertices.size());
+		for (int i = 0; i + 2 < mesh.Vertices.size(); i += 3)
 		{
-			FVector3 v0 = FVector3(mesh.Vertices[i + 0].Position.X, mesh.Vertices[i + 0].Position.Y, mesh.Vertices[i + 0].Position.Z);
-			FVector3 v1 = FVector3(mesh.Vertices[i + 1].Position.X, mesh.Vertices[i + 1].Position.Y, mesh.Vertices[i + 1].Position.Z);
-			FVector3 v2 = FVector3(mesh.Vertices[i + 2].Position.X, mesh.Vertices[i + 2].Position.Y, mesh.Vertices[i + 2].Position.Z);
+			for (int k = 0; k < 3; ++k)
+			{
+				const objl::Vertex& vertex = mesh.Vertices[i + k];
 
-			FVector2 uv0 = FVector2(mesh.Vertices[i + 0].TextureCoordinate.X, mesh.Vertices[i + 0].TextureCoordinate.Y);
-			FVector2 uv1 = FVector2(mesh.Vertices[i + 1].TextureCoordinate.X, mesh.Vertices[i + 1].TextureCoordinate.Y);
-			FVector2 uv2 = FVector2(mesh.Vertices[i + 2].TextureCoordinate.X, mesh.Vertices[i + 2].TextureCoordinate.Y);
+				FVector3 v = FVector3(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+				FNormal3 n = FNormal3(vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z);
+				if (bFlipHandedness)
+				{
+					v.z = -v.z;
+					n.z = -n.z;
+				}
 
-			if (bFlipHandedness)
-			{
-				v0.z = -v0.z;
-				v1.z = -v1.z;
-				v2.z = -v2.z;
+				v *= inScale;
+				v += offset;
+
+				if (flip_normal)
+				{
+					n = -n;
+				}
+
+				indexed.indices.push_back((uint32_t)indexed.positions.size());
+				indexed.positions.push_back(v);
+				indexed.uvs.push_back(FVector2(vertex.TextureCoordinate.X, vertex.TextureCoordinate.Y));
+				indexed.normals.push_back(n);
 			}
+		} // end for i
+
+		if (bCleanup)
+		{
+			CleanupTriangleMesh(filename, indexed);
+		}
 
-			v0 *= inScale;
-			v1 *= inScale;
-			v2 *= inScale;
+		std::shared_ptr<FTriangleMesh> trimesh = std::make_shared<FTriangleMesh>();
+		trimesh->Build(indexed.positions, indexed.uvs, indexed.normals, indexed.indices, flip_normal, compression);
 
-			v0 += offset;
-			v1 += offset;
-			v2 += offset;
-			std::shared_ptr<FTriangle> triangle = std::make_shared<FTriangle>(v0, v1, v2, uv0, uv1, uv2, flip_normal);
+		if (compression != MeshCompressNone && trimesh->TriangleNum() > 0)
+		{
+			// per triangle with the bvh the mesh is intersected through, which compression does not shrink
+			const size_t triangle_num = trimesh->TriangleNum();
+			const size_t bvh_bytes = FTriangleMesh::BVHMemorySize(triangle_num);
+			const size_t uncompressed = triangle_num * (sizeof(FTriangleMesh::FHotTriangle) + 3 * sizeof(uint32_t))
+				+ indexed.positions.size() * (sizeof(FPoint2) + sizeof(FNormal3));
 
-			outTriangles.push_back(triangle);
-		} // end for i
+			PBRT_PRINT("mesh compression %s: %d triangles, %.1f -> %.1f bytes per triangle (bvh %.1f)\n", filename, (int)triangle_num,
+				(uncompressed + bvh_bytes) / (double)triangle_num, (trimesh->MemorySize() + bvh_bytes) / (double)triangle_num,
+				bvh_bytes / (double)triangle_num);
+		}
+
+		outMesh = trimesh;
+		return true;
+	}
+
+	bool ScanTriangleMeshBounds(const char* filename, FBounds3& outBounds, bool bFlipHandedness, const FVector3& offset, Float inScale)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open())
+		{
+			PBRT_ERROR("scan triangle mesh failed. %s\n", filename);
+			return false;
+		}
+
+		FBounds3 bounds;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			float x, y, z;
+			if (line.size() < 2 || line[0] != 'v' || (line[1] != ' ' && line[1] != '\t'))
+				continue;
+			if (sscanf(line.c_str() + 2, "%f %f %f", &x, &y, &z) != 3)
+				continue;
+
+			FVector3 v(x, y, z);
+			if (bFlipHandedness)
+			{
+				v.z = -v.z;
+			}
+
+			bounds.Expand(v * inScale + offset);
+		} // end while
 
+		bounds.CheckThinness();
+		outBounds = bounds;
 		return true;
 	}
 
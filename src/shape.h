@@ -8,15 +8,19 @@
 #include "geometry.h"
 #include "sampling.h"
 #include "bsdf.h"
+#include "bvh.h"
 
 namespace pbrt
 {
 
 class FPrimitive;
+class FScene;
 class FAreaLight;
 class FMaterial;
 class FBSDF;
 class FSampler;
+class FMemoryArena;
+class FTriangleMesh;
 
 /*
   prev   n   light
@@ -35,27 +39,43 @@ class FIntersection
 public:
 	FPoint3		position; // world position of intersection
 	FNormal3	normal;
+	FNormal3	shadingNormal; // interpolated vertex normal on meshes, the bsdf frame. normal elsewhere
 	FVector3	wo;
 
 	const FPrimitive* primitive;
 
+	// triangle hit on a mesh, until ComputeShadingNormal reads its vertex normals
+	const FTriangleMesh* mesh;
+	uint32_t	triangle;
+
 	// constructor
 	FIntersection()
 		: primitive(nullptr)
+		, mesh(nullptr)
+		, triangle(0)
 	{}
 
 
 	FIntersection(const FPoint3 &pos, const FNormal3 &n, const FVector3& wo)
 		: position(pos)
 		, normal(n)
+		, shadingNormal(n)
 		, wo(wo)
 		, primitive(nullptr)
+		, mesh(nullptr)
+		, triangle(0)
 	{}
 
 	const FPrimitive* Primitive() const { return primitive; }
 
-	std::unique_ptr<FBSDF> Bsdf(FSampler* sampler) const;
-	FColor Le() const;
+	// the cold vertex normals are only read for the closest hit, once the traversal is done
+	void ComputeShadingNormal();
+
+	// allocated in arena, nullptr for interfaces without material
+	FBSDF* Bsdf(const FScene& scene, FSampler* sampler, FMemoryArena& arena) const;
+	FColor Le(const FScene& scene) const;
+	// nullptr when not on an area light
+	const FAreaLight* AreaLight(const FScene& scene) const;
 
 	// spawn a new ray start from this intersection to the direction
 	FRay SpawnRay(const FVector3& dir) const
@@ -90,6 +110,15 @@ struct FLightIntersection
 };
 
 
+// how an area light samples directions to its shape, see FScene::SetAreaLightSampling
+enum eShapeSampling
+{
+	ShapeSamplingArea = 0,		// uniform by area, converted to solid angle
+	ShapeSamplingSolidAngle,	// uniform by the solid angle the shape subtends, rectangles and triangles
+	ShapeSamplingCosine,		// by solid angle, warped towards the cosine at the receiving surface
+};
+
+
 /*
      z(0, 0, 1)
           |
@@ -111,6 +140,9 @@ public:
     virtual ~FShape() = default;
 
     virtual bool Intersect(const FRay &ray, FIntersection &oisect) const = 0;
+    // Intersect from a bvh leaf. shapes with a bvh of their own continue the caller's traversal
+    // on stack and count their nodes in visited, see FTriangleMeshShape and FTriangleMeshProxy
+    virtual bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const { return Intersect(ray, oisect); }
 
 	const FBounds3& WorldBounds() const { return worldBox; }
     virtual Float Area() const = 0;
@@ -119,9 +151,12 @@ public:
     // these methods below only used for `area_light_t`
     virtual FLightIntersection SamplePosition(const FFloat2& random, Float * out_pdf) const = 0;
 
+    // the normals of the sampled positions, bounds the emission of an area light
+    virtual FDirectionCone NormalBounds() const { return FDirectionCone::EntireSphere(); }
+
 
-    // default compute `*_direction` by `*_position` 
-    virtual FLightIntersection SampleDirection(const FIntersection & isect, const FFloat2& random, Float * out_pdf_direction) const
+    // default compute `*_direction` by `*_position`, sampling is a hint shapes may ignore
+    virtual FLightIntersection SampleDirection(const FIntersection & isect, const FFloat2& random, Float * out_pdf_direction, eShapeSampling) const
     {
         FLightIntersection light_isect = SamplePosition(random, out_pdf_direction);
         FVector3 wi = light_isect.position - isect.position;
@@ -144,7 +179,7 @@ public:
         return light_isect;
     }
 
-    virtual Float Pdf_Direction(const FIntersection & isect, const FVector3& world_wi) const
+    virtual Float Pdf_Direction(const FIntersection & isect, const FVector3& world_wi, eShapeSampling) const
     {
         FRay ray = isect.SpawnRay(world_wi);
         FIntersection isect_onlight;
@@ -180,6 +215,12 @@ public:
         return pdf;
     }
 
+protected:
+	// solid angles sampled by area instead: too small for the precision of the spherical samplers,
+	// or close to the whole hemisphere
+	static PBRT_CONSTEXPR Float MinSphericalSampleArea = (Float)3e-4;
+	static PBRT_CONSTEXPR Float MaxSphericalSampleArea = (Float)6.22;
+
 public:
 	FBounds3 worldBox;
 };
@@ -253,6 +294,8 @@ public:
 	Float Area() const override { return kPi * radius * radius; }
 
 public:
+	FDirectionCone NormalBounds() const override { return FDirectionCone(normal); }
+
     FLightIntersection SamplePosition(const FFloat2& random, Float* out_pdf) const override
 	{
         FLightIntersection light_isect;
@@ -273,22 +316,226 @@ public:
 	Float    radius;
 };
 
-// triangle shape
-class FTriangle : public FShape
+// mesh storage compression flags
+enum eMeshCompression
+{
+	MeshCompressNone = 0,
+	MeshCompressAttributes = 1, // octahedral 32-bit normals, half float uvs
+	MeshCompressPositions = 2   // 16-bit positions relative to the mesh bounds
+};
+
+// a triangle while the bvh of its mesh is built, the leaves only keep the index. see FTriangleMesh::BuildBVH
+struct FMeshTriangle
+{
+	FBounds3 bounds;
+	const FTriangleMesh* mesh;
+	uint32_t index;
+
+	const FBounds3& WorldBounds() const { return bounds; }
+};
+
+// triangle mesh storage
+//   hot data: per-triangle vertices and normal packed in one array, this is all the ray traversal touches.
+//   the leaves of the mesh's bvh keep triangle indices into it, there is no object per triangle.
+//   cold data: per-vertex uvs and shading normals, only touched for the final hit.
+//   both can optionally be stored compressed and are decoded on the fly.
+class FTriangleMesh
 {
 public:
-	FTriangle(const FPoint3 &p0, const FPoint3 &p1, FPoint3 &p2, const FPoint2& uv0, const FPoint2& uv1, const FPoint2& uv2, bool flip_normal = false)
-		: p0(p0), p1(p1), p2(p2)
-		, uv0(uv0), uv1(uv1), uv2(uv2)
+	struct FHotTriangle
 	{
-		normal = Normalize(Cross(p1 - p0, p2 - p0));
-		if (flip_normal)
-			normal = -normal;
+		FPoint3  p0, p1, p2;
+		FNormal3 normal;
+	};
 
-		worldBox = CalcWorldBounds();
+	// positions quantized to 16 bits per component
+	struct FQuantizedTriangle
+	{
+		uint16_t p[9];
+	};
+
+	FTriangleMesh()
+		: compression(MeshCompressNone)
+		, bFlipNormal(false)
+		, shadow_bvh(nullptr)
+		, bvhBytes(0)
+	{}
+
+	// build from an indexed triangle list, 3 indices per triangle
+	void Build(const std::vector<FPoint3>& positions, const std::vector<FPoint2>& inUVs, const std::vector<FNormal3>& inNormals,
+		const std::vector<uint32_t>& inIndices, bool flip_normal, int inCompression = MeshCompressNone);
+
+	size_t TriangleNum() const { return indices.size() / 3; }
+	bool IsQuantized() const { return (compression & MeshCompressPositions) != 0; }
+
+	// bvh over all triangles, lazyDepth and bParallel as for FBVH_Node
+	void BuildBVH(int lazyDepth, bool bParallel);
+	// bytes of the bvh BuildBVH makes over triangle_num triangles, once all of it is built
+	static size_t BVHMemorySize(size_t triangle_num);
+	// union of the triangle bounds, known before the bvh is built
+	const FBounds3& Bounds() const { return bounds; }
+
+	// copy of the storage with a bvh of its own, both allocated by the calling thread. run on a numa
+	// node to place the copy in its memory, see FScene::SetBVHReplication
+	std::shared_ptr<FTriangleMesh> CreateReplica(int lazyDepth) const;
+	// one replica per numa node, empty to traverse this mesh on every node
+	void SetReplicas(const std::vector<std::shared_ptr<FTriangleMesh>>& inReplicas);
+	// the replica of the calling thread's numa node, this mesh if there are none
+	const FTriangleMesh& Local() const { return shadow_replicas.empty() ? *this : *shadow_replicas[CurrentNumaNode()]; }
+
+	bool Intersect(const FRay& ray, FIntersection& oisect) const
+	{
+		const FBVH_NodeBase* root = Local().shadow_bvh;
+		return root && root->Intersect(ray, oisect);
 	}
 
-	bool Intersect(const FRay& ray, FIntersection& oisect) const override
+	// continues the caller's traversal with the nodes of the mesh, see FShape::Traverse
+	bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+	{
+		const FBVH_NodeBase* root = Local().shadow_bvh;
+		return root && root->Traverse(ray, oisect, stack, visited);
+	}
+
+	// ray vs triangle tri. a hit shortens the ray and records the triangle in oisect for the shading normal
+	bool IntersectTriangle(uint32_t tri, const FRay& ray, FIntersection& oisect) const
+	{
+		Float distance;
+		FNormal3 normal;
+
+		if (!IsQuantized())
+		{
+			const FHotTriangle& t = hot[tri];
+			if (!IntersectTriangle(t.p0, t.p1, t.p2, t.normal, ray, distance))
+				return false;
+
+			normal = t.normal;
+		}
+		else
+		{
+			FPoint3 p0, p1, p2;
+			GetPositions(tri, p0, p1, p2);
+
+			FVector3 n = Cross(p1 - p0, p2 - p0);
+			if (!IntersectTriangle(p0, p1, p2, n, ray, distance))
+				return false;
+
+			normal = FaceNormal(n);
+		}
+
+		ray.SetMaxT(distance);
+		oisect = FIntersection(ray(distance), normal, -ray.Dir());
+		oisect.mesh = this;
+		oisect.triangle = tri;
+
+		return true;
+	}
+
+	FBounds3 TriangleBounds(uint32_t tri) const
+	{
+		FPoint3 p0, p1, p2;
+		GetPositions(tri, p0, p1, p2);
+
+		FBounds3 bbox(p0, p1);
+		bbox = bbox.Join(p2);
+
+		bbox.CheckThinness();
+		return bbox;
+	}
+
+	void GetPositions(uint32_t tri, FPoint3& p0, FPoint3& p1, FPoint3& p2) const
+	{
+		if (!IsQuantized())
+		{
+			p0 = hot[tri].p0; p1 = hot[tri].p1; p2 = hot[tri].p2;
+			return;
+		}
+
+		const uint16_t* q = quantized[tri].p;
+		p0 = Dequantize(q + 0);
+		p1 = Dequantize(q + 3);
+		p2 = Dequantize(q + 6);
+	}
+
+	// unit geometric normal from the (unnormalized) plane normal Cross(p1 - p0, p2 - p0)
+	FNormal3 FaceNormal(const FVector3& n) const
+	{
+		return bFlipNormal ? -Normalize(n) : Normalize(n);
+	}
+
+	FHotTriangle GetTriangle(uint32_t tri) const
+	{
+		if (!IsQuantized())
+			return hot[tri];
+
+		FHotTriangle t;
+		GetPositions(tri, t.p0, t.p1, t.p2);
+		t.normal = FaceNormal(Cross(t.p1 - t.p0, t.p2 - t.p0));
+		return t;
+	}
+
+	void GetUVs(uint32_t tri, FPoint2& uv0, FPoint2& uv1, FPoint2& uv2) const
+	{
+		const uint32_t* v = &indices[tri * 3];
+		if (compression & MeshCompressAttributes)
+		{
+			uv0 = UnpackUV(packedUVs[v[0]]); uv1 = UnpackUV(packedUVs[v[1]]); uv2 = UnpackUV(packedUVs[v[2]]);
+		}
+		else
+		{
+			uv0 = uvs[v[0]]; uv1 = uvs[v[1]]; uv2 = uvs[v[2]];
+		}
+	}
+
+	void GetNormals(uint32_t tri, FNormal3& n0, FNormal3& n1, FNormal3& n2) const
+	{
+		const uint32_t* v = &indices[tri * 3];
+		if (compression & MeshCompressAttributes)
+		{
+			n0 = DecodeOctahedral(packedNormals[v[0]]); n1 = DecodeOctahedral(packedNormals[v[1]]); n2 = DecodeOctahedral(packedNormals[v[2]]);
+		}
+		else
+		{
+			n0 = normals[v[0]]; n1 = normals[v[1]]; n2 = normals[v[2]];
+		}
+	}
+
+	// vertex normals of tri interpolated at p, turned to the side of the geometric normal ng.
+	// ng when the mesh has no vertex normals
+	FNormal3 ShadingNormal(uint32_t tri, const FPoint3& p, const FNormal3& ng) const
+	{
+		FPoint3 p0, p1, p2;
+		GetPositions(tri, p0, p1, p2);
+
+		FVector3 n = Cross(p1 - p0, p2 - p0);
+		Float area2 = n.Length2();
+		if (area2 == 0)
+			return ng;
+
+		FNormal3 n0, n1, n2;
+		GetNormals(tri, n0, n1, n2);
+
+		Float b0 = Dot(n, Cross(p2 - p1, p - p1)) / area2;
+		Float b1 = Dot(n, Cross(p0 - p2, p - p2)) / area2;
+		Float b2 = 1 - b0 - b1;
+
+		FNormal3 ns = n0 * b0 + n1 * b1 + n2 * b2;
+		if (ns.IsZero())
+			return ng;
+
+		ns = Normalize(ns);
+		return Dot(ns, ng) < 0 ? -ns : ns;
+	}
+
+	size_t MemorySize() const
+	{
+		return hot.size() * sizeof(FHotTriangle) + quantized.size() * sizeof(FQuantizedTriangle) + indices.size() * sizeof(uint32_t)
+			+ uvs.size() * sizeof(FPoint2) + normals.size() * sizeof(FNormal3)
+			+ packedUVs.size() * sizeof(uint32_t) + packedNormals.size() * sizeof(uint32_t)
+			+ bvhBytes;
+	}
+
+	// ray vs triangle (p0, p1, p2), n is the plane normal and need not be unit length
+	static bool IntersectTriangle(const FPoint3& p0, const FPoint3& p1, const FPoint3& p2, const FVector3& n, const FRay& ray, Float& distance)
 	{
 		// https://github.com/SmallVCM/SmallVCM/blob/master/src/geometry.hxx#L125-L156
 
@@ -311,26 +558,165 @@ public:
 			//    by `dot(normal, op)` (or `bo`, `co`)
 			// 2. then calculate the distance from ray.origin to the plane alone ray.direction, 
 			//    by `distance * dot(normal, ray.direction()) = vertical_distance`
-			const Float distance = Dot(normal, oa) / Dot(normal, ray.Dir());
+			distance = Dot(n, oa) / Dot(n, ray.Dir());
 
-			if ((distance > ray.MinT()) && (distance < ray.MaxT()))
-			{
-				ray.SetMaxT(distance);
-				FPoint3 hit_point = ray(distance);
-				oisect = FIntersection(hit_point, normal, -ray.Dir());
-
-				return true;
-			}
+			return (distance > ray.MinT()) && (distance < ray.MaxT());
 		}
 
 		return false;
 	}
 
+protected:
+	FPoint3 Dequantize(const uint16_t* q) const
+	{
+		return FPoint3(
+			quantizeOrigin.x + q[0] * quantizeScale.x,
+			quantizeOrigin.y + q[1] * quantizeScale.y,
+			quantizeOrigin.z + q[2] * quantizeScale.z);
+	}
+
+	static FPoint2 UnpackUV(uint32_t packed)
+	{
+		return FPoint2(HalfToFloat((uint16_t)(packed & 0xffff)), HalfToFloat((uint16_t)(packed >> 16)));
+	}
+
+protected:
+	int  compression;
+	bool bFlipNormal;
+
+	// hot
+	std::vector<FHotTriangle> hot;
+	std::vector<FQuantizedTriangle> quantized;
+	FPoint3  quantizeOrigin;
+	FVector3 quantizeScale;
+
+	// cold
+	std::vector<uint32_t> indices; // vertex attribute indices, 3 per triangle
+	std::vector<FPoint2>  uvs;
+	std::vector<FNormal3> normals;
+	std::vector<uint32_t> packedUVs;
+	std::vector<uint32_t> packedNormals;
+
+	FBounds3 bounds;
+	std::shared_ptr<FBVH_NodeBase> bvh;
+	FBVH_NodeBase* shadow_bvh;
+	// build records, kept while lazy subtrees of the bvh may still be built
+	std::vector<FMeshTriangle> bvhTriangles;
+	size_t bvhBytes;
+
+	std::vector<std::shared_ptr<FTriangleMesh>> replicas;
+	std::vector<const FTriangleMesh*> shadow_replicas;
+};
+
+// leaf of a mesh bvh
+//   the triangle indices sit in the node and are tested against the mesh's hot array directly,
+//   without a shape object or a separate allocation per leaf
+template<>
+class FBVH_NodeLeaf<FMeshTriangle*> : public FBVH_NodeBase
+{
+public:
+	// [start, end)
+	FBVH_NodeLeaf(std::vector<FMeshTriangle*>& objects, size_t start, size_t end)
+		: mesh(objects[start]->mesh)
+		, count((uint32_t)(end - start))
+	{
+		PBRT_DOCHECK(count <= MAX_HITTABLES_IN_LEAF);
+
+		FBounds3 boundingbox;
+		for (size_t i = start; i < end; i++)
+		{
+			triangles[i - start] = objects[i]->index;
+
+			boundingbox.Expand(objects[i]->WorldBounds());
+		}
+
+		bbox = boundingbox;
+	}
+
+	virtual bool Intersect(const FRay& ray, FIntersection& oisect) const
+	{
+		bool bHit = false;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bHit |= mesh->IntersectTriangle(triangles[i], ray, oisect);
+		}
+
+		return bHit;
+	}
+
+	virtual bool Visit(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const
+	{
+		return Intersect(ray, oisect);
+	}
+
+	virtual std::shared_ptr<FBVH_NodeBase> Clone() const
+	{
+		return std::make_shared<FBVH_NodeLeaf<FMeshTriangle*>>(*this);
+	}
+
+protected:
+	const FTriangleMesh* mesh;
+	uint32_t count;
+	uint32_t triangles[MAX_HITTABLES_IN_LEAF];
+};
+
+// triangle mesh as one shape
+//   intersected through the bvh of the mesh, which continues the scene traversal. the bvh is built
+//   by FScene::Preprocess. it has no shape per triangle and can not be used as an area light,
+//   see FTriangle for that.
+class FTriangleMeshShape : public FShape
+{
+public:
+	FTriangleMeshShape(const FTriangleMesh* inMesh)
+		: mesh(inMesh)
+	{
+		worldBox = mesh->Bounds();
+	}
+
+	bool Intersect(const FRay& ray, FIntersection& oisect) const override
+	{
+		return mesh->Intersect(ray, oisect);
+	}
+
+	bool Traverse(const FRay& ray, FIntersection& oisect, FBVHStack& stack, uint64_t& visited) const override
+	{
+		return mesh->Traverse(ray, oisect, stack, visited);
+	}
+
+	Float Area() const override { return 0; }
+	FLightIntersection SamplePosition(const FFloat2& random, Float* out_pdf) const override;
+
+protected:
+	const FTriangleMesh* mesh;
+};
+
+// triangle shape, a reference into a triangle mesh
+//   one object per triangle, for area lights. meshes that only reflect are one FTriangleMeshShape
+class FTriangle : public FShape
+{
+public:
+	FTriangle(const FTriangleMesh* inMesh, uint32_t inIndex)
+		: mesh(inMesh)
+		, index(inIndex)
+	{
+		worldBox = CalcWorldBounds();
+	}
+
+	bool Intersect(const FRay& ray, FIntersection& oisect) const override
+	{
+		return mesh->IntersectTriangle(index, ray, oisect);
+	}
+
 	FPoint2 GetUV(const FVector3& p) const
 	{
-		Float Area2 = Dot((p1 - p0), (p2 - p0));
-		Float A2 = Dot((p - p0), (p1 - p0));
-		Float B2 = Dot((p - p1), (p2 - p1));
+		const FTriangleMesh::FHotTriangle tri = Triangle();
+		FPoint2 uv0, uv1, uv2;
+		mesh->GetUVs(index, uv0, uv1, uv2);
+
+		Float Area2 = Dot((tri.p1 - tri.p0), (tri.p2 - tri.p0));
+		Float A2 = Dot((p - tri.p0), (tri.p1 - tri.p0));
+		Float B2 = Dot((p - tri.p1), (tri.p2 - tri.p1));
 
 		Float e2 = A2 / Area2;
 		Float e0 = B2 / Area2;
@@ -341,35 +727,112 @@ public:
 
 	FBounds3 CalcWorldBounds() const
 	{
-		FBounds3 bbox(p0, p1);
-		bbox = bbox.Join(p2);
+		return mesh->TriangleBounds(index);
+	}
 
-		bbox.CheckThinness();
-		return bbox;
+	Float Area() const override
+	{
+		const FTriangleMesh::FHotTriangle tri = Triangle();
+		return (Float)0.5f * Cross(tri.p1 - tri.p0, tri.p2 - tri.p0).Length();
 	}
 
-	Float Area() const override { return (Float)0.5f * Cross(p1 - p0, p2 - p0).Length(); }
+	FDirectionCone NormalBounds() const override { return FDirectionCone(Triangle().normal); }
 
 	FLightIntersection SamplePosition(const FFloat2& random, Float* out_pdf) const override
 	{
+		const FTriangleMesh::FHotTriangle tri = Triangle();
 		FPoint2 b = uniform_triangle_sample(random);
 
 		FLightIntersection light_isect;
-		light_isect.position = b.x * p0 + b.y * p1 + (1 - b.x - b.y) * p2;
-		light_isect.normal = normal;
+		light_isect.position = b.x * tri.p0 + b.y * tri.p1 + (1 - b.x - b.y) * tri.p2;
+		light_isect.normal = tri.normal;
 
 		*out_pdf = 1 / Area();
 		return light_isect;
 	}
 
+	// uniform in the spherical triangle seen from isect, samples close to a large light spread over
+	// its solid angle rather than its area
+	FLightIntersection SampleDirection(const FIntersection& isect, const FFloat2& random, Float* out_pdf_direction, eShapeSampling sampling) const override
+	{
+		const FTriangleMesh::FHotTriangle tri = Triangle();
+		const FPoint3 v[3] = { tri.p0, tri.p1, tri.p2 };
+
+		Float solidAngle = (sampling != ShapeSamplingArea) ? spherical_triangle_area(v, isect.position) : 0;
+		if (solidAngle < MinSphericalSampleArea || solidAngle > MaxSphericalSampleArea)
+			return FShape::SampleDirection(isect, random, out_pdf_direction, ShapeSamplingArea);
+
+		FFloat2 uv = random;
+		Float pdf = 1;
+		if (sampling == ShapeSamplingCosine)
+		{
+			Float w[4];
+			CornerCosines(tri, isect, w);
+			uv = bilinear_sample(random, w);
+			pdf = bilinear_pdf(uv, w);
+		}
+
+		Float triPdf;
+		FVector3 b = spherical_triangle_sample(v, isect.position, uv, &triPdf);
+
+		FLightIntersection light_isect;
+		light_isect.position = b.x * tri.p0 + b.y * tri.p1 + b.z * tri.p2;
+		light_isect.normal = tri.normal;
+
+		*out_pdf_direction = pdf * triPdf;
+		return light_isect;
+	}
+
+	Float Pdf_Direction(const FIntersection& isect, const FVector3& world_wi, eShapeSampling sampling) const override
+	{
+		const FTriangleMesh::FHotTriangle tri = Triangle();
+		const FPoint3 v[3] = { tri.p0, tri.p1, tri.p2 };
+
+		Float solidAngle = (sampling != ShapeSamplingArea) ? spherical_triangle_area(v, isect.position) : 0;
+		if (solidAngle < MinSphericalSampleArea || solidAngle > MaxSphericalSampleArea)
+			return FShape::Pdf_Direction(isect, world_wi, ShapeSamplingArea);
+
+		FIntersection isect_onlight;
+		if (!Intersect(isect.SpawnRay(world_wi), isect_onlight))
+			return 0;
+
+		Float pdf = 1 / solidAngle;
+		if (sampling == ShapeSamplingCosine)
+		{
+			Float w[4];
+			CornerCosines(tri, isect, w);
+			pdf *= bilinear_pdf(invert_spherical_triangle_sample(v, isect.position, world_wi), w);
+		}
+
+		return pdf;
+	}
+
+protected:
+	FTriangleMesh::FHotTriangle Triangle() const
+	{
+		return mesh->GetTriangle(index);
+	}
+
+	// cosines at isect to the corners of the uv square of spherical_triangle_sample: p1, p1, p0, p2
+	static void CornerCosines(const FTriangleMesh::FHotTriangle& tri, const FIntersection& isect, Float w[4])
+	{
+		w[0] = w[1] = std::max((Float)0.01, AbsDot(isect.normal, Normalize(tri.p1 - isect.position)));
+		w[2] = std::max((Float)0.01, AbsDot(isect.normal, Normalize(tri.p0 - isect.position)));
+		w[3] = std::max((Float)0.01, AbsDot(isect.normal, Normalize(tri.p2 - isect.position)));
+	}
+
 public:
-	FPoint3 p0, p1, p2;
-	FPoint2 uv0, uv1, uv2;
-	FNormal3 normal;
+	const FTriangleMesh* mesh;
+	uint32_t index;
 };
 
 // load triangles from *.obj file
-bool LoadTriangleMesh(const char* filename, std::vector<std::shared_ptr<FTriangle>> &outTriangles, bool flip_normal = false, bool bFlipHandedness = false, const FVector3& offset=FVector3(0,0,0), Float inScale=1.f);
+//   bCleanup: weld duplicate vertices, drop degenerate triangles and reorder triangles along a morton curve
+//   compression: eMeshCompression flags for the mesh storage
+bool LoadTriangleMesh(const char* filename, std::shared_ptr<FTriangleMesh> &outMesh, bool flip_normal = false, bool bFlipHandedness = false, const FVector3& offset=FVector3(0,0,0), Float inScale=1.f, bool bCleanup = false, int compression = MeshCompressNone);
+
+// bounding box of the vertices in *.obj file, without keeping the mesh in memory
+bool ScanTriangleMeshBounds(const char* filename, FBounds3& outBounds, bool bFlipHandedness = false, const FVector3& offset = FVector3(0, 0, 0), Float inScale = 1.f);
 
 
 // rectangle
@@ -389,6 +852,10 @@ public:
 		if (flip_normal)
 			normal = -normal;
 
+		// the spherical rectangle sampling needs perpendicular edges
+		const FVector3 ex = p0 - p1, ey = p2 - p1;
+		bRectangular = std::abs(Dot(ex, ey)) <= (Float)1e-4 * ex.Length() * ey.Length();
+
 		worldBox = CalcWorldBounds();
 	}
 
@@ -456,6 +923,8 @@ public:
 
 	Float Area() const override { return Cross(p0 - p1, p2 - p1).Length(); }
 
+	FDirectionCone NormalBounds() const override { return FDirectionCone(normal); }
+
 	FLightIntersection SamplePosition(const FFloat2& random, Float* out_pdf) const override
 	{
 		FLightIntersection light_isect;
@@ -466,9 +935,68 @@ public:
 		return light_isect;
 	}
 
+	// uniform in the spherical rectangle seen from isect, parallelograms are sampled by area
+	FLightIntersection SampleDirection(const FIntersection& isect, const FFloat2& random, Float* out_pdf_direction, eShapeSampling sampling) const override
+	{
+		Float solidAngle = (sampling != ShapeSamplingArea && bRectangular) ? spherical_rectangle_area(isect.position, p1, p0 - p1, p2 - p1) : 0;
+		if (solidAngle < MinSphericalSampleArea || solidAngle > MaxSphericalSampleArea)
+			return FShape::SampleDirection(isect, random, out_pdf_direction, ShapeSamplingArea);
+
+		FFloat2 uv = random;
+		Float pdf = 1;
+		if (sampling == ShapeSamplingCosine)
+		{
+			Float w[4];
+			CornerCosines(isect, w);
+			uv = bilinear_sample(random, w);
+			pdf = bilinear_pdf(uv, w);
+		}
+
+		Float rectPdf;
+		FLightIntersection light_isect;
+		light_isect.position = spherical_rectangle_sample(isect.position, p1, p0 - p1, p2 - p1, uv, &rectPdf);
+		light_isect.normal = normal;
+
+		*out_pdf_direction = pdf * rectPdf;
+		return light_isect;
+	}
+
+	Float Pdf_Direction(const FIntersection& isect, const FVector3& world_wi, eShapeSampling sampling) const override
+	{
+		Float solidAngle = (sampling != ShapeSamplingArea && bRectangular) ? spherical_rectangle_area(isect.position, p1, p0 - p1, p2 - p1) : 0;
+		if (solidAngle < MinSphericalSampleArea || solidAngle > MaxSphericalSampleArea)
+			return FShape::Pdf_Direction(isect, world_wi, ShapeSamplingArea);
+
+		FIntersection isect_onlight;
+		if (!Intersect(isect.SpawnRay(world_wi), isect_onlight))
+			return 0;
+
+		Float pdf = 1 / solidAngle;
+		if (sampling == ShapeSamplingCosine)
+		{
+			Float w[4];
+			CornerCosines(isect, w);
+			pdf *= bilinear_pdf(invert_spherical_rectangle_sample(isect.position, p1, p0 - p1, p2 - p1, isect_onlight.position), w);
+		}
+
+		return pdf;
+	}
+
+protected:
+	// cosines at isect to the corners of the uv square of spherical_rectangle_sample: p1, p0, p2, p3
+	void CornerCosines(const FIntersection& isect, Float w[4]) const
+	{
+		const FPoint3 corners[4] = { p1, p0, p2, p3 };
+		for (int i = 0; i < 4; ++i)
+		{
+			w[i] = std::max((Float)0.01, AbsDot(isect.normal, Normalize(corners[i] - isect.position)));
+		}
+	}
+
 public:
 	FPoint3 p0, p1, p2, p3;
 	FNormal3 normal;
+	bool bRectangular;
 };
 
 
@@ -561,14 +1089,13 @@ public:
     }
 
     // TODO: confirm
-    FLightIntersection SampleDirection(const FIntersection& isect, const FFloat2& random, Float* out_pdf_direction) const override
+    FLightIntersection SampleDirection(const FIntersection& isect, const FFloat2& random, Float* out_pdf_direction, eShapeSampling) const override
     {
         // station 1: In or On the sphere
         if (Distance2(isect.position, center) <= radius * radius)
         {
             FLightIntersection light_isect = SamplePosition(random, out_pdf_direction);
             FVector3 wi = light_isect.position - isect.position;
-            Float dist2 = wi.Length2();
 
             if (wi.Length2() == 0)
                 *out_pdf_direction = 0;
@@ -643,11 +1170,11 @@ public:
         return light_isect;
     }
 
-    Float Pdf_Direction(const FIntersection& isect, const FVector3& world_wi) const override
+    Float Pdf_Direction(const FIntersection& isect, const FVector3& world_wi, eShapeSampling sampling) const override
     {
         // return uniform PDF if point is inside sphere
         if (Distance2(isect.position, center) <= radius * radius)
-            return FShape::Pdf_Direction(isect, world_wi);
+            return FShape::Pdf_Direction(isect, world_wi, sampling);
 
         // compute general sphere PDF
         Float sin_theta_max_sq = radius * radius / Distance2(isect.position, center);